@@ -0,0 +1,612 @@
+// The analyses built into the simulator. New ones only need a class deriving from
+// AnalysisPlugin and a registerAnalysis call, here or from the embedding program.
+
+#include "AnalysisPipeline.h"
+#include "Coverage.h"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+using namespace std;
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole == 0 ? 0.0 : 100.0 * part / whole;
+}
+
+// --------------------------------------------------------------------------
+// branch-stats: outcomes per conditional branch, and how a bimodal predictor
+// of 2-bit counters per branch would have done on them
+// --------------------------------------------------------------------------
+
+class BranchStats : public AnalysisPlugin
+{
+    public:
+        BranchStats() : branches(0), taken(0), backwardTaken(0), mispredicts(0), jumps(0), indirect(0) {}
+
+        void consume(const InstEvent *events, size_t count) override {
+            for (size_t i = 0; i < count; i++) {
+                const InstEvent &e = events[i];
+                if (e.kind == EVENT_JUMP) {
+                    jumps++;
+                    indirect += (e.instruction & 0x7f) == OP_JALR;
+                    continue;
+                }
+                if (e.kind != EVENT_BRANCH) {
+                    continue;
+                }
+                Site &site = sites[e.pc];
+                site.executions++;
+                branches++;
+                bool predicted = site.counter >= 2;
+                if (predicted != (bool)e.taken) {
+                    site.mispredicts++;
+                    mispredicts++;
+                }
+                if (e.taken) {
+                    site.taken++;
+                    taken++;
+                    backwardTaken += e.nextPC < e.pc;
+                    site.counter += site.counter < 3;
+                }
+                else {
+                    site.counter -= site.counter > 0;
+                }
+            }
+        }
+
+        // Each part's predictor started out cold, so a merged accuracy is slightly pessimistic.
+        void merge(const AnalysisPlugin &other) override {
+            const BranchStats &o = static_cast<const BranchStats &>(other);
+            for (unordered_map<uint64_t, Site>::const_iterator it = o.sites.begin(); it != o.sites.end(); ++it) {
+                Site &site = sites[it->first];
+                site.executions += it->second.executions;
+                site.taken += it->second.taken;
+                site.mispredicts += it->second.mispredicts;
+                site.counter = it->second.counter;
+            }
+            branches += o.branches;
+            taken += o.taken;
+            backwardTaken += o.backwardTaken;
+            mispredicts += o.mispredicts;
+            jumps += o.jumps;
+            indirect += o.indirect;
+        }
+
+        void report(FILE *out) override {
+            fprintf(out, "conditional branches %lu, taken %lu (%.2f%%), backward taken %lu, static sites %lu\n",
+                    branches, taken, percent(taken, branches), backwardTaken, (uint64_t)sites.size());
+            fprintf(out, "2-bit bimodal predictor: %lu mispredicts, %.2f%% accuracy\n",
+                    mispredicts, 100.0 - percent(mispredicts, branches));
+            fprintf(out, "jumps %lu, of which indirect (jalr) %lu\n", jumps, indirect);
+
+            vector<pair<uint64_t, Site> > worst(sites.begin(), sites.end());
+            sort(worst.begin(), worst.end(), [](const pair<uint64_t, Site> &a, const pair<uint64_t, Site> &b) {
+                return a.second.mispredicts != b.second.mispredicts ? a.second.mispredicts > b.second.mispredicts
+                                                                    : a.first < b.first;
+            });
+            if (worst.size() > 10) {
+                worst.resize(10);
+            }
+            fprintf(out, "%-10s  %12s %8s %12s\n", "pc", "executions", "taken", "mispredicts");
+            for (size_t i = 0; i < worst.size(); i++) {
+                const Site &site = worst[i].second;
+                fprintf(out, "0x%08lx  %12lu %7.2f%% %12lu\n", worst[i].first, site.executions,
+                        percent(site.taken, site.executions), site.mispredicts);
+            }
+        }
+
+    private:
+        struct Site {
+            uint64_t executions = 0;
+            uint64_t taken = 0;
+            uint64_t mispredicts = 0;
+            uint8_t counter = 1; // weakly not taken
+        };
+
+        unordered_map<uint64_t, Site> sites;
+        uint64_t branches;
+        uint64_t taken;
+        uint64_t backwardTaken;
+        uint64_t mispredicts;
+        uint64_t jumps;
+        uint64_t indirect;
+};
+
+// --------------------------------------------------------------------------
+// mix: executed instructions by class, by mnemonic, and memory accesses by size
+// --------------------------------------------------------------------------
+
+class InstructionMix : public AnalysisPlugin
+{
+    public:
+        InstructionMix() : total(0), kinds(), sizes(), operations() {}
+
+        void consume(const InstEvent *events, size_t count) override {
+            for (size_t i = 0; i < count; i++) {
+                const InstEvent &e = events[i];
+                kinds[e.kind]++;
+                sizes[e.memSize & 15]++;
+                operations[coverageOperation(e.instruction)]++;
+            }
+            total += count;
+        }
+
+        void merge(const AnalysisPlugin &other) override {
+            const InstructionMix &o = static_cast<const InstructionMix &>(other);
+            total += o.total;
+            for (unsigned k = 0; k < EVENT_KINDS; k++) {
+                kinds[k] += o.kinds[k];
+            }
+            for (unsigned s = 0; s < 16; s++) {
+                sizes[s] += o.sizes[s];
+            }
+            for (unsigned op = 0; op < COVERAGE_OPS; op++) {
+                operations[op] += o.operations[op];
+            }
+        }
+
+        void report(FILE *out) override {
+            static const char *KIND_NAMES[EVENT_KINDS] = {"alu", "load", "store", "branch", "jump"};
+            fprintf(out, "instructions %lu\n", total);
+            for (unsigned k = 0; k < EVENT_KINDS; k++) {
+                fprintf(out, "  %-8s %14lu %7.2f%%\n", KIND_NAMES[k], kinds[k], percent(kinds[k], total));
+            }
+            fprintf(out, "memory accesses by size:");
+            for (unsigned s = 1; s <= 8; s <<= 1) {
+                fprintf(out, " %uB %lu", s, sizes[s]);
+            }
+            fprintf(out, "\n");
+
+            vector<pair<uint64_t, string> > byCount;
+            for (unsigned op = 0; op < COVERAGE_OPS; op++) {
+                if (operations[op] != 0) {
+                    byCount.push_back(make_pair(operations[op], string(coverageOperationName(op))));
+                }
+            }
+            sort(byCount.rbegin(), byCount.rend());
+            for (size_t i = 0; i < byCount.size(); i++) {
+                fprintf(out, "  %-8s %14lu %7.2f%%\n", byCount[i].second.c_str(), byCount[i].first,
+                        percent(byCount[i].first, total));
+            }
+        }
+
+    private:
+        uint64_t total;
+        uint64_t kinds[EVENT_KINDS];
+        uint64_t sizes[16];
+        uint64_t operations[COVERAGE_OPS]; // by the operations of Coverage.h
+};
+
+// --------------------------------------------------------------------------
+// reuse: LRU stack distances of instruction fetches and data accesses for a
+// range of cache line sizes, which give the miss rate of a fully associative
+// LRU cache of every size from one run; the working set per window of
+// instructions; and the strides of the data accesses to each memory region
+// --------------------------------------------------------------------------
+
+// Counts at positions 1..size() with prefix sums, both in O(log size).
+class FenwickTree
+{
+    public:
+        explicit FenwickTree(size_t size = 0) : counts(size + 1, 0) {}
+
+        size_t size() const { return counts.size() - 1; }
+
+        void add(size_t position, int64_t delta) {
+            for (; position < counts.size(); position += position & (0 - position)) {
+                counts[position] += delta;
+            }
+        }
+
+        // the sum over positions 1..position
+        int64_t prefix(size_t position) const {
+            int64_t sum = 0;
+            for (; position > 0; position -= position & (0 - position)) {
+                sum += counts[position];
+            }
+            return sum;
+        }
+
+    private:
+        vector<int64_t> counts;
+};
+
+// Stack distances 0, 1, 2-3, 4-7, ... go to buckets 0, 1, 2, 3, ...
+static const unsigned REUSE_BUCKETS = 64;
+// Accesses between working set samples.
+static const uint64_t WORKING_SET_WINDOW = 1 << 16;
+// The line size of the working set.
+static const uint64_t WORKING_SET_LINE = 64;
+// Data strides are told apart per region of this many bytes.
+static const uint64_t STRIDE_REGION = 1024;
+
+static unsigned reuseBucket(uint64_t distance) {
+    return distance == 0 ? 0 : 64 - __builtin_clzll(distance);
+}
+
+// The LRU stack distance of every access to lines of one size: how many other
+// lines were used since the last access to the same line. Each line remembers
+// the slot (a logical time) of its last access and the tree has a 1 at every
+// slot that is some line's last access, so the distance is a range count. Slots
+// are renumbered whenever they run out, which keeps the tree the size of the
+// memory instead of the run.
+class StackDistances
+{
+    public:
+        explicit StackDistances(uint64_t lineSize)
+            : lineShift(__builtin_ctzll(lineSize)), lastSlot(MEMORY_SIZE >> lineShift, 0),
+              tree(2 * (MEMORY_SIZE >> lineShift)), nextSlot(1), mru(UINT64_MAX), accesses(0),
+              histogram(REUSE_BUCKETS, 0) {}
+
+        uint64_t getLineSize() const { return 1ULL << lineShift; }
+        uint64_t getAccesses() const { return accesses; }
+        uint64_t getCold() const { return firstTouches.size(); }
+        const vector<uint64_t> &getHistogram() const { return histogram; }
+
+        // Accesses outside RAM go to devices, which are not cached.
+        void access(uint64_t address) {
+            if (address >= MEMORY_SIZE) {
+                return;
+            }
+            accesses++;
+            uint64_t line = address >> lineShift;
+            // Touching the most recent line again changes no distances; its old
+            // slot still has only its own accesses after it.
+            if (line == mru) {
+                histogram[0]++;
+                return;
+            }
+            mru = line;
+            if (nextSlot > tree.size()) {
+                renumber();
+            }
+            uint64_t slot = nextSlot++;
+            uint64_t last = lastSlot[line];
+            if (last == 0) {
+                firstTouches.push_back(line);
+            }
+            else {
+                histogram[reuseBucket(tree.prefix(slot - 1) - tree.prefix(last))]++;
+                tree.add(last, -1);
+            }
+            tree.add(slot, 1);
+            lastSlot[line] = slot;
+        }
+
+        // Appends the accesses of other, which followed this one's. Its first
+        // touch of a line seen here was counted cold but is a reuse: of the
+        // lines used before it, the i earlier first touches of other and the
+        // lines above it in this stack, minus those counted in both.
+        void merge(const StackDistances &other) {
+            vector<uint64_t> stack = lruOrder();
+            vector<uint64_t> depth(lastSlot.size(), UINT64_MAX);
+            for (size_t d = 0; d < stack.size(); d++) {
+                depth[stack[d]] = d;
+            }
+            FenwickTree seen(stack.size());
+            vector<uint64_t> touches = firstTouches;
+            for (size_t i = 0; i < other.firstTouches.size(); i++) {
+                uint64_t line = other.firstTouches[i];
+                uint64_t d = depth[line];
+                if (d == UINT64_MAX) {
+                    touches.push_back(line);
+                    continue;
+                }
+                uint64_t distance = i + d - seen.prefix(d);
+                histogram[reuseBucket(distance)]++;
+                seen.add(d + 1, 1);
+            }
+            firstTouches.swap(touches);
+            for (unsigned b = 0; b < REUSE_BUCKETS; b++) {
+                histogram[b] += other.histogram[b];
+            }
+            accesses += other.accesses;
+
+            // other's lines are the most recent, in their order
+            for (size_t line = 0; line < lastSlot.size(); line++) {
+                if (other.lastSlot[line] != 0) {
+                    lastSlot[line] = nextSlot + other.lastSlot[line];
+                }
+            }
+            if (other.mru != UINT64_MAX) {
+                mru = other.mru;
+            }
+            renumber();
+        }
+
+        // Misses of a fully associative LRU cache of lines lines, a power of 2:
+        // the cold ones and those with a distance of lines or more.
+        uint64_t misses(uint64_t lines) const {
+            uint64_t count = getCold();
+            for (unsigned b = reuseBucket(lines); b < REUSE_BUCKETS; b++) {
+                count += histogram[b];
+            }
+            return count;
+        }
+
+    private:
+        // lines by last access, most recent first
+        vector<uint64_t> lruOrder() const {
+            vector<pair<uint64_t, uint64_t> > bySlot;
+            for (size_t line = 0; line < lastSlot.size(); line++) {
+                if (lastSlot[line] != 0) {
+                    bySlot.push_back(make_pair(lastSlot[line], line));
+                }
+            }
+            sort(bySlot.rbegin(), bySlot.rend());
+            vector<uint64_t> order(bySlot.size());
+            for (size_t i = 0; i < bySlot.size(); i++) {
+                order[i] = bySlot[i].second;
+            }
+            return order;
+        }
+
+        // Gives the lines slots 1..n in their order, with the rest of the tree free.
+        void renumber() {
+            vector<uint64_t> order = lruOrder();
+            tree = FenwickTree(tree.size());
+            for (size_t i = 0; i < order.size(); i++) {
+                uint64_t slot = order.size() - i;
+                lastSlot[order[i]] = slot;
+                tree.add(slot, 1);
+            }
+            nextSlot = order.size() + 1;
+        }
+
+        unsigned lineShift;
+        vector<uint64_t> lastSlot; // per line, 0 if never accessed
+        FenwickTree tree;
+        uint64_t nextSlot;
+        uint64_t mru;
+        uint64_t accesses;
+        vector<uint64_t> histogram;
+        vector<uint64_t> firstTouches; // lines in the order of their first access, the cold misses
+};
+
+class ReuseDistance : public AnalysisPlugin
+{
+    public:
+        ReuseDistance() : instructions(0), windowInstructions(0), codeLines(WORKING_SET_WORDS, 0), dataLines(WORKING_SET_WORDS, 0),
+                          regions(MEMORY_SIZE / STRIDE_REGION) {
+            for (uint64_t size = 16; size <= 128; size *= 2) {
+                fetches.push_back(StackDistances(size));
+                data.push_back(StackDistances(size));
+            }
+        }
+
+        void consume(const InstEvent *events, size_t count) override {
+            for (size_t i = 0; i < count; i++) {
+                const InstEvent &e = events[i];
+                instructions++;
+                for (size_t s = 0; s < fetches.size(); s++) {
+                    fetches[s].access(e.pc);
+                }
+                markLine(codeLines, e.pc);
+                if (e.memSize != 0) {
+                    for (size_t s = 0; s < data.size(); s++) {
+                        data[s].access(e.memAddress);
+                    }
+                    markLine(dataLines, e.memAddress);
+                    stride(e.memAddress);
+                }
+                if (++windowInstructions == WORKING_SET_WINDOW) {
+                    endWindow();
+                }
+            }
+        }
+
+        // Working set windows restart with every part, so they line up with the
+        // ones of a single run when the interval is a multiple of the window.
+        void merge(const AnalysisPlugin &other) override {
+            const ReuseDistance &o = static_cast<const ReuseDistance &>(other);
+            if (windowInstructions > 0) {
+                endWindow();
+            }
+            for (size_t s = 0; s < fetches.size(); s++) {
+                fetches[s].merge(o.fetches[s]);
+                data[s].merge(o.data[s]);
+            }
+            instructions += o.instructions;
+            codeSets.insert(codeSets.end(), o.codeSets.begin(), o.codeSets.end());
+            dataSets.insert(dataSets.end(), o.dataSets.begin(), o.dataSets.end());
+            codeLines = o.codeLines;
+            dataLines = o.dataLines;
+            windowInstructions = o.windowInstructions;
+            for (size_t r = 0; r < regions.size(); r++) {
+                regions[r].merge(o.regions[r]);
+            }
+        }
+
+        void report(FILE *out) override {
+            if (windowInstructions > 0) {
+                endWindow();
+            }
+            reportMisses(out, "instruction fetches", fetches);
+            reportMisses(out, "data accesses", data);
+            reportWorkingSet(out);
+            reportStrides(out);
+        }
+
+    private:
+        static const size_t WORKING_SET_WORDS = MEMORY_SIZE / WORKING_SET_LINE / 64;
+
+        // The accesses to one region of memory, for stride detection. Strides
+        // between two addresses in a region are within +-STRIDE_REGION, so they
+        // are counted exactly, once the region sees its second access.
+        struct Region {
+            uint64_t accesses = 0;
+            uint64_t lastAddress = 0;
+            int64_t lastStride = 0;
+            uint64_t repeats = 0;     // strides equal to the one before
+            vector<uint64_t> strides; // by stride + STRIDE_REGION
+
+            void merge(const Region &other) {
+                if (other.accesses == 0) {
+                    return;
+                }
+                if (strides.empty()) {
+                    strides = other.strides;
+                }
+                else {
+                    for (size_t i = 0; i < other.strides.size(); i++) {
+                        strides[i] += other.strides[i];
+                    }
+                }
+                repeats += other.repeats;
+                accesses += other.accesses;
+                lastAddress = other.lastAddress;
+                lastStride = other.lastStride;
+            }
+
+            int64_t commonStride() const {
+                size_t best = max_element(strides.begin(), strides.end()) - strides.begin();
+                return (int64_t)best - (int64_t)STRIDE_REGION;
+            }
+        };
+
+        static void markLine(vector<uint64_t> &lines, uint64_t address) {
+            if (address < MEMORY_SIZE) {
+                uint64_t line = address / WORKING_SET_LINE;
+                lines[line / 64] |= 1ULL << (line % 64);
+            }
+        }
+
+        static uint64_t countLines(vector<uint64_t> &lines) {
+            uint64_t count = 0;
+            for (size_t w = 0; w < lines.size(); w++) {
+                count += __builtin_popcountll(lines[w]);
+                lines[w] = 0;
+            }
+            return count;
+        }
+
+        void endWindow() {
+            windowInstructions = 0;
+            codeSets.push_back(countLines(codeLines) * WORKING_SET_LINE);
+            dataSets.push_back(countLines(dataLines) * WORKING_SET_LINE);
+        }
+
+        void stride(uint64_t address) {
+            if (address >= MEMORY_SIZE) {
+                return;
+            }
+            Region &r = regions[address / STRIDE_REGION];
+            if (r.accesses > 0) {
+                int64_t stride = (int64_t)(address - r.lastAddress);
+                r.repeats += r.accesses > 1 && stride == r.lastStride;
+                if (r.strides.empty()) {
+                    r.strides.assign(2 * STRIDE_REGION, 0);
+                }
+                r.strides[stride + STRIDE_REGION]++;
+                r.lastStride = stride;
+            }
+            r.lastAddress = address;
+            r.accesses++;
+        }
+
+        static void reportMisses(FILE *out, const char *what, const vector<StackDistances> &stacks) {
+            fprintf(out, "%s: predicted miss rate of a fully associative LRU cache\n", what);
+            fprintf(out, "%10s", "cache size");
+            for (size_t s = 0; s < stacks.size(); s++) {
+                fprintf(out, "  %5luB lines", stacks[s].getLineSize());
+            }
+            fprintf(out, "\n");
+            for (uint64_t bytes = 256; bytes <= MEMORY_SIZE; bytes *= 2) {
+                fprintf(out, "%9luB", bytes);
+                for (size_t s = 0; s < stacks.size(); s++) {
+                    const StackDistances &stack = stacks[s];
+                    fprintf(out, "  %11.3f%%", percent(stack.misses(bytes / stack.getLineSize()), stack.getAccesses()));
+                }
+                fprintf(out, "\n");
+            }
+            // the distances themselves, at the middle line size
+            const StackDistances &stack = stacks[stacks.size() / 2];
+            fprintf(out, "stack distances at %luB lines (%lu accesses, %lu cold):", stack.getLineSize(),
+                    stack.getAccesses(), stack.getCold());
+            const vector<uint64_t> &histogram = stack.getHistogram();
+            for (unsigned b = 0; b < REUSE_BUCKETS; b++) {
+                if (histogram[b] != 0) {
+                    fprintf(out, " <%lu:%lu", (uint64_t)1 << b, histogram[b]);
+                }
+            }
+            fprintf(out, "\n");
+        }
+
+        void reportWorkingSet(FILE *out) const {
+            if (codeSets.empty()) {
+                return;
+            }
+            fprintf(out, "working set per %lu instructions (%luB lines), %zu windows:\n",
+                    WORKING_SET_WINDOW, WORKING_SET_LINE, codeSets.size());
+            const vector<uint64_t> *sets[2] = { &codeSets, &dataSets };
+            const char *names[2] = { "code", "data" };
+            for (int k = 0; k < 2; k++) {
+                const vector<uint64_t> &v = *sets[k];
+                uint64_t sum = 0;
+                for (size_t i = 0; i < v.size(); i++) {
+                    sum += v[i];
+                }
+                fprintf(out, "  %s: min %luB, mean %luB, max %luB\n", names[k], *min_element(v.begin(), v.end()),
+                        sum / v.size(), *max_element(v.begin(), v.end()));
+            }
+            // at most 16 windows spread over the run
+            size_t step = (codeSets.size() + 15) / 16;
+            fprintf(out, "  %12s %10s %10s\n", "instruction", "code", "data");
+            for (size_t i = 0; i < codeSets.size(); i += step) {
+                fprintf(out, "  %12lu %9luB %9luB\n", i * WORKING_SET_WINDOW, codeSets[i], dataSets[i]);
+            }
+        }
+
+        void reportStrides(FILE *out) const {
+            vector<size_t> order;
+            for (size_t r = 0; r < regions.size(); r++) {
+                if (regions[r].accesses > 0) {
+                    order.push_back(r);
+                }
+            }
+            if (order.empty()) {
+                return;
+            }
+            sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+                return regions[a].accesses != regions[b].accesses ? regions[a].accesses > regions[b].accesses : a < b;
+            });
+            if (order.size() > 10) {
+                order.resize(10);
+            }
+            fprintf(out, "data strides per %luB region:\n", STRIDE_REGION);
+            fprintf(out, "  %-10s %12s %8s %10s %10s\n", "region", "accesses", "stride", "share", "repeated");
+            for (size_t i = 0; i < order.size(); i++) {
+                const Region &r = regions[order[i]];
+                if (r.strides.empty()) {
+                    fprintf(out, "  0x%08lx %12lu\n", order[i] * STRIDE_REGION, r.accesses);
+                    continue;
+                }
+                int64_t common = r.commonStride();
+                fprintf(out, "  0x%08lx %12lu %+8ld %9.2f%% %9.2f%%\n", order[i] * STRIDE_REGION, r.accesses, common,
+                        percent(r.strides[common + STRIDE_REGION], r.accesses - 1),
+                        percent(r.repeats, r.accesses > 2 ? r.accesses - 2 : 0));
+            }
+        }
+
+        uint64_t instructions;
+        uint64_t windowInstructions;
+        vector<StackDistances> fetches; // by line size, 16 to 128 bytes
+        vector<StackDistances> data;
+        vector<uint64_t> codeLines; // bitmaps of the lines used in the current window
+        vector<uint64_t> dataLines;
+        vector<uint64_t> codeSets;  // working set bytes per window
+        vector<uint64_t> dataSets;
+        vector<Region> regions;
+};
+
+static AnalysisPlugin *newBranchStats() { return new BranchStats(); }
+static AnalysisPlugin *newInstructionMix() { return new InstructionMix(); }
+static AnalysisPlugin *newReuseDistance() { return new ReuseDistance(); }
+
+void registerBuiltinAnalyses() {
+    registerAnalysis("branch-stats", "branch outcomes and 2-bit predictor accuracy per branch", newBranchStats);
+    registerAnalysis("mix", "executed instructions by class and mnemonic", newInstructionMix);
+    registerAnalysis("reuse", "reuse distances, miss rate per cache size, working set and strides",
+                     newReuseDistance);
+}
@@ -0,0 +1,165 @@
+#include "AnalysisPipeline.h"
+
+#include <chrono>
+
+using namespace std;
+
+// defined in Analyses.cpp
+void registerBuiltinAnalyses();
+
+// empty polls before a consumer yields its core, and before it starts sleeping
+static const unsigned SPIN_POLLS = 64;
+static const unsigned YIELD_POLLS = 4096;
+
+struct AnalysisEntry {
+    string name;
+    string description;
+    AnalysisFactory factory;
+};
+
+static vector<AnalysisEntry> &registry() {
+    static vector<AnalysisEntry> entries;
+    static bool initialized = false;
+    if (!initialized) {
+        initialized = true;
+        registerBuiltinAnalyses();
+    }
+    return entries;
+}
+
+void registerAnalysis(const char *name, const char *description, AnalysisFactory factory) {
+    registry().push_back({name, description, factory});
+}
+
+AnalysisPlugin *createAnalysis(const string &name) {
+    vector<AnalysisEntry> &entries = registry();
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].name == name) {
+            return entries[i].factory();
+        }
+    }
+    return NULL;
+}
+
+void printAnalyses(FILE *out) {
+    vector<AnalysisEntry> &entries = registry();
+    for (size_t i = 0; i < entries.size(); i++) {
+        fprintf(out, "  %-16s %s\n", entries[i].name.c_str(), entries[i].description.c_str());
+    }
+}
+
+AnalysisPipeline::AnalysisPipeline(bool threaded)
+    : batchCount(0), published(0), threaded(threaded), started(false), done(false) {}
+
+AnalysisPipeline::~AnalysisPipeline() {
+    finish();
+}
+
+void AnalysisPipeline::add(const string &name, AnalysisPlugin *plugin) {
+    Consumer *consumer = new Consumer();
+    consumer->name = name;
+    consumer->plugin.reset(plugin);
+    consumers.push_back(unique_ptr<Consumer>(consumer));
+}
+
+unique_ptr<AnalysisPlugin> AnalysisPipeline::takePlugin(size_t index) {
+    finish();
+    return move(consumers[index]->plugin);
+}
+
+void AnalysisPipeline::start() {
+    started = true;
+    for (size_t i = 0; i < consumers.size(); i++) {
+        consumers[i]->ring.reset(new SpscRing<InstEvent>(ANALYSIS_RING_EVENTS));
+        consumers[i]->thread = thread(&AnalysisPipeline::consumeLoop, this, consumers[i].get());
+    }
+}
+
+void AnalysisPipeline::consumeLoop(Consumer *consumer) {
+    unsigned idle = 0;
+    while (true) {
+        const InstEvent *events;
+        size_t n = consumer->ring->peek(events);
+        if (n > 0) {
+            consumer->plugin->consume(events, n);
+            consumer->ring->pop(n);
+            idle = 0;
+            continue;
+        }
+        if (done.load(memory_order_acquire)) {
+            // everything was pushed before done was set
+            if (consumer->ring->empty()) {
+                break;
+            }
+            continue;
+        }
+        if (++idle < SPIN_POLLS) {
+            continue;
+        }
+        if (idle < YIELD_POLLS) {
+            this_thread::yield();
+        }
+        else {
+            // the simulator is paused or slow; stop burning a core on it
+            this_thread::sleep_for(chrono::microseconds(50));
+        }
+    }
+}
+
+void AnalysisPipeline::flush() {
+    if (batchCount == 0 || consumers.empty()) {
+        batchCount = 0;
+        return;
+    }
+    if (!threaded) {
+        for (size_t i = 0; i < consumers.size(); i++) {
+            consumers[i]->plugin->consume(batch, batchCount);
+        }
+        published += batchCount;
+        batchCount = 0;
+        return;
+    }
+    if (!started) {
+        start();
+    }
+    for (size_t i = 0; i < consumers.size(); i++) {
+        Consumer &consumer = *consumers[i];
+        size_t sent = consumer.ring->push(batch, batchCount);
+        if (sent < batchCount) {
+            // back-pressure: wait for this consumer to make room
+            consumer.stalls++;
+            while (sent < batchCount) {
+                this_thread::yield();
+                sent += consumer.ring->push(batch + sent, batchCount - sent);
+            }
+        }
+    }
+    published += batchCount;
+    batchCount = 0;
+}
+
+void AnalysisPipeline::finish() {
+    flush();
+    if (!started || done) {
+        return;
+    }
+    done.store(true, memory_order_release);
+    for (size_t i = 0; i < consumers.size(); i++) {
+        consumers[i]->thread.join();
+    }
+}
+
+void AnalysisPipeline::report(FILE *out) {
+    finish();
+    uint64_t batches = (published + ANALYSIS_BATCH - 1) / ANALYSIS_BATCH;
+    for (size_t i = 0; i < consumers.size(); i++) {
+        fprintf(out, "\n==== %s ====\n", consumers[i]->name.c_str());
+        consumers[i]->plugin->report(out);
+    }
+    fprintf(out, "\n%lu events published", published);
+    for (size_t i = 0; i < consumers.size(); i++) {
+        fprintf(out, "%s %s stalled %lu of %lu batches", i == 0 ? ";" : ",",
+                consumers[i]->name.c_str(), consumers[i]->stalls, batches);
+    }
+    fprintf(out, "\n");
+}
@@ -0,0 +1,153 @@
+#ifndef ANALYSIS_PIPELINE_H
+#define ANALYSIS_PIPELINE_H
+
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "sim.h"
+#include "SpscRing.h"
+
+// events the simulator thread collects before handing them to the consumers
+#define ANALYSIS_BATCH 256
+// events queued per consumer before the simulator has to wait
+#define ANALYSIS_RING_EVENTS (1 << 16)
+
+enum InstEventKind : uint8_t {
+    EVENT_ALU = 0, // register and immediate arithmetic, lui, auipc, nop
+    EVENT_LOAD,
+    EVENT_STORE,
+    EVENT_BRANCH,  // conditional; taken tells the outcome
+    EVENT_JUMP,    // jal and jalr
+    EVENT_KINDS
+};
+
+// What an analysis gets to see of one executed instruction.
+struct InstEvent {
+    uint64_t pc;
+    uint64_t nextPC;
+    uint64_t memAddress;  // loads and stores only
+    uint32_t instruction; // raw bits, for finer classification
+    uint8_t  kind;        // InstEventKind
+    uint8_t  memSize;     // bytes accessed, 0 if none
+    uint8_t  taken;       // branches only
+    uint8_t  rd;
+};
+
+// An analysis run on its own thread over the stream of executed instructions.
+// consume is only ever called from that thread, so plugins need no locking.
+class AnalysisPlugin
+{
+    public:
+        virtual ~AnalysisPlugin() {}
+
+        virtual void consume(const InstEvent *events, size_t count) = 0;
+
+        // Adds in the results of other, an instance of the same analysis that
+        // consumed the events following this one's (see IntervalSimulation).
+        virtual void merge(const AnalysisPlugin &other) = 0;
+
+        // Called once the stream has ended and every event has been consumed.
+        virtual void report(FILE *out) = 0;
+};
+
+typedef AnalysisPlugin *(*AnalysisFactory)();
+
+// Makes an analysis available to createAnalysis under name.
+void registerAnalysis(const char *name, const char *description, AnalysisFactory factory);
+
+// A new instance of the analysis registered as name, or NULL.
+AnalysisPlugin *createAnalysis(const std::string &name);
+
+// Lists the registered analyses, one per line.
+void printAnalyses(FILE *out);
+
+// Publishes executed instructions to a set of analyses, each consuming them from
+// its own ring buffer on its own thread. The simulator only pays for filling in
+// events; analysis costs wall-clock time only when a consumer falls so far behind
+// that its ring fills up and the simulator has to wait for it.
+class AnalysisPipeline
+{
+    public:
+        // Without threaded, the plugins consume each batch on the publishing
+        // thread, for callers that already run one pipeline per core.
+        explicit AnalysisPipeline(bool threaded = true);
+        ~AnalysisPipeline();
+
+        // Takes ownership of plugin. Only before the first publish.
+        void add(const std::string &name, AnalysisPlugin *plugin);
+
+        // Hands the index'th plugin back to the caller, once finished.
+        std::unique_ptr<AnalysisPlugin> takePlugin(size_t index);
+
+        bool empty() const { return consumers.empty(); }
+
+        // Called by Simulator::step for every executed instruction.
+        void publish(const Instruction &inst) {
+            InstEvent &e = batch[batchCount];
+            e.pc = inst.PC;
+            e.nextPC = inst.nextPC;
+            e.instruction = inst.instruction;
+            e.rd = inst.rd;
+            e.memAddress = inst.memAddress;
+            e.memSize = inst.readsMem || inst.writesMem ? 1 << (inst.funct3 & 3) : 0;
+            e.taken = 0;
+            if (inst.readsMem) {
+                e.kind = EVENT_LOAD;
+            }
+            else if (inst.writesMem) {
+                e.kind = EVENT_STORE;
+            }
+            else if (inst.isSB) {
+                e.kind = EVENT_BRANCH;
+                e.taken = inst.nextPC != inst.PC + inst.length;
+            }
+            else if (inst.opcode == OP_JAL || inst.opcode == OP_JALR) {
+                e.kind = EVENT_JUMP;
+            }
+            else {
+                e.kind = EVENT_ALU;
+            }
+            if (++batchCount == ANALYSIS_BATCH) {
+                flush();
+            }
+        }
+
+        // Hands the events collected so far to the consumers.
+        void flush();
+
+        // Ends the stream and waits for every consumer to drain its ring.
+        void finish();
+
+        // Each analysis's report, then how often the simulator had to wait.
+        void report(FILE *out);
+
+    private:
+        struct Consumer {
+            std::string name;
+            std::unique_ptr<AnalysisPlugin> plugin;
+            std::unique_ptr<SpscRing<InstEvent> > ring; // threaded pipelines only
+            std::thread thread;
+            uint64_t stalls; // batches that found the ring full
+
+            Consumer() : stalls(0) {}
+        };
+
+        AnalysisPipeline(const AnalysisPipeline &) = delete;
+        AnalysisPipeline &operator=(const AnalysisPipeline &) = delete;
+
+        void start();
+        void consumeLoop(Consumer *consumer);
+
+        std::vector<std::unique_ptr<Consumer> > consumers;
+        InstEvent batch[ANALYSIS_BATCH];
+        size_t batchCount;
+        uint64_t published;
+        bool threaded;
+        bool started;
+        std::atomic<bool> done;
+};
+
+#endif
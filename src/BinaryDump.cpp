@@ -0,0 +1,154 @@
+#include "BinaryDump.h"
+#include "PagedMemoryStore.h"
+#include "TranslationCache.h"
+
+#include <string.h>
+
+using namespace std;
+
+static const char DUMP_MAGIC[8] = {'R', 'V', 'S', 'I', 'M', 'D', 'M', 'P'};
+static const uint32_t DUMP_VERSION = 1;
+
+struct DumpRecordHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t kind;
+    uint64_t instructionCount;
+    uint64_t pc;
+    uint64_t registers[REG_SIZE];
+    uint32_t pageShift;
+    uint32_t pageCount;      // page records following the header
+    uint64_t checksum;       // of this header, with checksum zero
+};
+
+struct DumpPageHeader {
+    uint32_t index;
+    uint32_t reserved;
+    uint64_t checksum;       // of the page contents
+};
+
+static uint64_t headerChecksum(DumpRecordHeader header) {
+    header.checksum = 0;
+    return hashImage((const uint8_t *)&header, sizeof(header));
+}
+
+static bool isZero(const uint8_t *page) {
+    for (uint64_t i = 0; i < MEM_PAGE_SIZE; i++) {
+        if (page[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool writeDumpRecord(FILE *f, DumpKind kind, const REGS &regs, uint64_t pc,
+                     uint64_t instructionCount, MemoryStore *mem) {
+    PagedMemoryStore *paged = dynamic_cast<PagedMemoryStore *>(mem);
+    if (paged == NULL) {
+        kind = DUMP_FULL;
+    }
+
+    // gather the pages first, the header needs their count
+    vector<uint8_t> copy;
+    const uint8_t *memory;
+    if (paged != NULL) {
+        memory = paged->data();
+    }
+    else {
+        copy.resize(MEMORY_SIZE);
+        for (uint64_t addr = 0; addr < MEMORY_SIZE; addr += 8) {
+            uint64_t value = 0;
+            mem->getMemValue(addr, value, DOUBLE_SIZE);
+            memcpy(&copy[addr], &value, 8);
+        }
+        memory = copy.data();
+    }
+    vector<uint32_t> pages;
+    for (uint64_t page = 0; page < MEM_NUM_PAGES; page++) {
+        const uint8_t *bytes = memory + (page << MEM_PAGE_SHIFT);
+        if (kind == DUMP_DELTA ? paged->isChangedSinceDump(page) : !isZero(bytes)) {
+            pages.push_back(page);
+        }
+    }
+
+    DumpRecordHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DUMP_MAGIC, sizeof(DUMP_MAGIC));
+    header.version = DUMP_VERSION;
+    header.kind = kind;
+    header.instructionCount = instructionCount;
+    header.pc = pc;
+    memcpy(header.registers, regs.registers, sizeof(header.registers));
+    header.pageShift = MEM_PAGE_SHIFT;
+    header.pageCount = pages.size();
+    header.checksum = headerChecksum(header);
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    for (size_t i = 0; i < pages.size() && ok; i++) {
+        const uint8_t *bytes = memory + ((uint64_t)pages[i] << MEM_PAGE_SHIFT);
+        DumpPageHeader pageHeader = {pages[i], 0, hashImage(bytes, MEM_PAGE_SIZE)};
+        ok = fwrite(&pageHeader, sizeof(pageHeader), 1, f) == 1 && fwrite(bytes, MEM_PAGE_SIZE, 1, f) == 1;
+    }
+    if (!ok) {
+        fprintf(stderr, "[ERROR] Could not write binary dump\n");
+        return false;
+    }
+    if (paged != NULL) {
+        paged->clearChangedSinceDump();
+    }
+    return true;
+}
+
+int readDumpRecord(FILE *f, DumpState &state, DumpRecordInfo &info) {
+    DumpRecordHeader header;
+    size_t got = fread(&header, 1, sizeof(header), f);
+    if (got == 0 && feof(f)) {
+        return 0;
+    }
+    if (got != sizeof(header) || memcmp(header.magic, DUMP_MAGIC, sizeof(DUMP_MAGIC)) != 0) {
+        fprintf(stderr, "[ERROR] Not a binary dump record\n");
+        return -1;
+    }
+    if (header.version != DUMP_VERSION || header.pageShift != MEM_PAGE_SHIFT) {
+        fprintf(stderr, "[ERROR] Binary dump version %u with %u-bit pages is not supported\n",
+                header.version, header.pageShift);
+        return -1;
+    }
+    if (header.checksum != headerChecksum(header)) {
+        fprintf(stderr, "[ERROR] Binary dump record header checksum mismatch\n");
+        return -1;
+    }
+    if (header.kind == DUMP_FULL) {
+        state.memory.assign(MEMORY_SIZE, 0);
+    }
+    else if (header.kind != DUMP_DELTA || state.memory.empty()) {
+        fprintf(stderr, "[ERROR] Binary dump does not start with a full record\n");
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < header.pageCount; i++) {
+        DumpPageHeader pageHeader;
+        if (fread(&pageHeader, sizeof(pageHeader), 1, f) != 1 || pageHeader.index >= MEM_NUM_PAGES) {
+            fprintf(stderr, "[ERROR] Binary dump truncated or corrupt\n");
+            return -1;
+        }
+        uint8_t *bytes = &state.memory[(uint64_t)pageHeader.index << MEM_PAGE_SHIFT];
+        if (fread(bytes, MEM_PAGE_SIZE, 1, f) != 1) {
+            fprintf(stderr, "[ERROR] Binary dump truncated\n");
+            return -1;
+        }
+        if (hashImage(bytes, MEM_PAGE_SIZE) != pageHeader.checksum) {
+            fprintf(stderr, "[ERROR] Checksum mismatch in page %u\n", pageHeader.index);
+            return -1;
+        }
+    }
+
+    memcpy(state.regs.registers, header.registers, sizeof(header.registers));
+    state.pc = header.pc;
+    state.instructionCount = header.instructionCount;
+    info.kind = (DumpKind)header.kind;
+    info.pc = header.pc;
+    info.instructionCount = header.instructionCount;
+    info.pageCount = header.pageCount;
+    return 1;
+}
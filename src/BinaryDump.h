@@ -0,0 +1,46 @@
+#ifndef BINARY_DUMP_H
+#define BINARY_DUMP_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "sim.h"
+
+// A binary dump file is a sequence of records. Each record holds the registers,
+// PC and instruction count at one point of a run, and some memory pages, each
+// with an FNV-1a checksum (as is the record header):
+//  - a full record has every page that is not all zero;
+//  - a delta record has the pages changed since the previous record, which
+//    requires a PagedMemoryStore (any other store gets a full record instead).
+// The state after record n is the first record with records 1..n applied on top.
+
+enum DumpKind {
+    DUMP_FULL = 0,
+    DUMP_DELTA = 1
+};
+
+// Machine state rebuilt from a dump.
+struct DumpState {
+    REGS regs;
+    uint64_t pc = 0;
+    uint64_t instructionCount = 0;
+    std::vector<uint8_t> memory;
+};
+
+// What a record held, for listings.
+struct DumpRecordInfo {
+    DumpKind kind;
+    uint64_t pc;
+    uint64_t instructionCount;
+    uint32_t pageCount;
+};
+
+// Appends a record of the given state to f and starts a new delta there.
+bool writeDumpRecord(FILE *f, DumpKind kind, const REGS &regs, uint64_t pc,
+                     uint64_t instructionCount, MemoryStore *mem);
+
+// Reads the next record of f into state. Returns 1 if a record was applied,
+// 0 at the end of the file and -1 (after printing why) if the file is corrupt.
+int readDumpRecord(FILE *f, DumpState &state, DumpRecordInfo &info);
+
+#endif
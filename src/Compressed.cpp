@@ -0,0 +1,168 @@
+// RV64C: the 16-bit compressed instructions. Every one stands for a 32-bit
+// instruction, so instead of decoding them separately the fetch stage swaps in
+// that instruction, looked up in a table of all 65536 parcels built once.
+
+#include "sim.h"
+
+using namespace std;
+
+//               15  13 12 11     7 6      2 1  0
+// CR  type:    | funct4   | rd/rs1 | rs2    | op |
+// CI  type:    | f3 |imm | rd/rs1 | imm    | op |
+// CSS type:    | f3 | imm         | rs2    | op |
+// CIW type:    | f3 | imm              | rd' | op |
+// CL  type:    | f3 | imm | rs1' | imm | rd' | op |
+// CS  type:    | f3 | imm | rs1' | imm | rs2'| op |
+// CB  type:    | f3 | off | rs1' | off       | op |
+// CJ  type:    | f3 | jump target          | op |
+
+// bits [hi:lo] of a parcel
+static uint32_t field(uint32_t c, int hi, int lo) {
+    return (c >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+
+// the 3-bit register fields name x8..x15
+static uint32_t cReg(uint32_t c, int lo) {
+    return 8 + field(c, lo + 2, lo);
+}
+
+static uint32_t encodeR(uint32_t op, uint32_t f3, uint32_t f7, uint32_t rd, uint32_t rs1, uint32_t rs2) {
+    return (f7 << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+}
+
+static uint32_t encodeI(uint32_t op, uint32_t f3, uint32_t rd, uint32_t rs1, int64_t imm) {
+    return ((uint32_t)imm << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+}
+
+static uint32_t encodeS(uint32_t f3, uint32_t rs1, uint32_t rs2, uint32_t imm) {
+    return ((imm >> 5) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | ((imm & 31) << 7) | OP_STORE;
+}
+
+static uint32_t encodeB(uint32_t f3, uint32_t rs1, int64_t offset) {
+    uint32_t u = (uint32_t)offset;
+    return (((u >> 12) & 1) << 31) | (((u >> 5) & 63) << 25) | (rs1 << 15) | (f3 << 12) |
+           (((u >> 1) & 15) << 8) | (((u >> 11) & 1) << 7) | OP_SBTYPE;
+}
+
+static uint32_t encodeJ(uint32_t rd, int64_t offset) {
+    uint32_t u = (uint32_t)offset;
+    return (((u >> 20) & 1) << 31) | (((u >> 1) & 1023) << 21) | (((u >> 11) & 1) << 20) |
+           (((u >> 12) & 255) << 12) | (rd << 7) | OP_JAL;
+}
+
+// The 32-bit equivalent of a compressed parcel, or 0 if it is reserved or one of
+// the floating point loads and stores, which are not supported.
+static uint32_t expandParcel(uint32_t c) {
+    uint32_t rd = field(c, 11, 7); // rs1 as well in the CR and CI forms
+    uint32_t rs2 = field(c, 6, 2);
+    int64_t imm6 = signExtend((field(c, 12, 12) << 5) | field(c, 6, 2), 6);
+    uint32_t shamt = (field(c, 12, 12) << 5) | field(c, 6, 2);
+    uint32_t lwOffset = (field(c, 12, 10) << 3) | (field(c, 6, 6) << 2) | (field(c, 5, 5) << 6);
+    uint32_t ldOffset = (field(c, 12, 10) << 3) | (field(c, 6, 5) << 6);
+
+    // in octal: the quadrant (op), then funct3
+    switch ((field(c, 1, 0) << 3) | field(c, 15, 13)) {
+        // -------- quadrant 0 --------
+        case 000: { // c.addi4spn
+            uint32_t imm = (field(c, 12, 11) << 4) | (field(c, 10, 7) << 6) | (field(c, 6, 6) << 2) | (field(c, 5, 5) << 3);
+            return imm == 0 ? 0 : encodeI(OP_INTIMM, FUNCT3_ADD_SUB, cReg(c, 2), 2, imm);
+        }
+        case 002: // c.lw
+            return encodeI(OP_LOAD, FUNCT3_LW, cReg(c, 2), cReg(c, 7), lwOffset);
+        case 003: // c.ld
+            return encodeI(OP_LOAD, FUNCT3_LD, cReg(c, 2), cReg(c, 7), ldOffset);
+        case 006: // c.sw
+            return encodeS(FUNCT3_SW, cReg(c, 7), cReg(c, 2), lwOffset);
+        case 007: // c.sd
+            return encodeS(FUNCT3_SD, cReg(c, 7), cReg(c, 2), ldOffset);
+
+        // -------- quadrant 1 --------
+        case 010: // c.addi, c.nop
+            return encodeI(OP_INTIMM, FUNCT3_ADD_SUB, rd, rd, imm6);
+        case 011: // c.addiw
+            return rd == 0 ? 0 : encodeI(OP_INTIMMW, FUNCT3_ADD_SUB, rd, rd, imm6);
+        case 012: // c.li
+            return encodeI(OP_INTIMM, FUNCT3_ADD_SUB, rd, 0, imm6);
+        case 013:
+            if (rd == 2) { // c.addi16sp
+                int64_t imm = signExtend((field(c, 12, 12) << 9) | (field(c, 6, 6) << 4) | (field(c, 5, 5) << 6) |
+                                         (field(c, 4, 3) << 7) | (field(c, 2, 2) << 5), 10);
+                return imm == 0 ? 0 : encodeI(OP_INTIMM, FUNCT3_ADD_SUB, 2, 2, imm);
+            }
+            // c.lui
+            return imm6 == 0 ? 0 : (((uint32_t)imm6 << 12) | (rd << 7) | OP_LUI);
+        case 014: {
+            uint32_t rdc = cReg(c, 7), rs2c = cReg(c, 2);
+            switch (field(c, 11, 10)) {
+                case 0: // c.srli
+                    return encodeI(OP_INTIMM, FUNCT3_SRL_SRA, rdc, rdc, shamt);
+                case 1: // c.srai
+                    return encodeI(OP_INTIMM, FUNCT3_SRL_SRA, rdc, rdc, (FUNCT7_SUB_SRA << 5) | shamt);
+                case 2: // c.andi
+                    return encodeI(OP_INTIMM, FUNCT3_AND, rdc, rdc, imm6);
+            }
+            if (field(c, 12, 12) == 0) {
+                static const uint32_t f3s[4] = {FUNCT3_ADD_SUB, FUNCT3_XOR, FUNCT3_OR, FUNCT3_AND};
+                uint32_t f7 = field(c, 6, 5) == 0 ? FUNCT7_SUB_SRA : FUNCT7_DEFAULT; // c.sub
+                return encodeR(OP_RTYPE, f3s[field(c, 6, 5)], f7, rdc, rdc, rs2c);
+            }
+            switch (field(c, 6, 5)) {
+                case 0: return encodeR(OP_RTYPEW, FUNCT3_ADD_SUB, FUNCT7_SUB_SRA, rdc, rdc, rs2c); // c.subw
+                case 1: return encodeR(OP_RTYPEW, FUNCT3_ADD_SUB, FUNCT7_DEFAULT, rdc, rdc, rs2c); // c.addw
+            }
+            return 0;
+        }
+        case 015: // c.j
+            return encodeJ(0, signExtend((field(c, 12, 12) << 11) | (field(c, 11, 11) << 4) | (field(c, 10, 9) << 8) |
+                                         (field(c, 8, 8) << 10) | (field(c, 7, 7) << 6) | (field(c, 6, 6) << 7) |
+                                         (field(c, 5, 3) << 1) | (field(c, 2, 2) << 5), 12));
+        case 016: // c.beqz
+        case 017: { // c.bnez
+            int64_t offset = signExtend((field(c, 12, 12) << 8) | (field(c, 11, 10) << 3) | (field(c, 6, 5) << 6) |
+                                        (field(c, 4, 3) << 1) | (field(c, 2, 2) << 5), 9);
+            return encodeB(field(c, 13, 13) ? FUNCT3_BNE : FUNCT3_BEQ, cReg(c, 7), offset);
+        }
+
+        // -------- quadrant 2 --------
+        case 020: // c.slli
+            return encodeI(OP_INTIMM, FUNCT3_SLL, rd, rd, shamt);
+        case 022: // c.lwsp
+            return rd == 0 ? 0 : encodeI(OP_LOAD, FUNCT3_LW, rd, 2,
+                                         (field(c, 12, 12) << 5) | (field(c, 6, 4) << 2) | (field(c, 3, 2) << 6));
+        case 023: // c.ldsp
+            return rd == 0 ? 0 : encodeI(OP_LOAD, FUNCT3_LD, rd, 2,
+                                         (field(c, 12, 12) << 5) | (field(c, 6, 5) << 3) | (field(c, 4, 2) << 6));
+        case 024:
+            if (field(c, 12, 12) == 0) {
+                if (rs2 == 0) { // c.jr
+                    return rd == 0 ? 0 : encodeI(OP_JALR, FUNCT3_JALR, 0, rd, 0);
+                }
+                return encodeR(OP_RTYPE, FUNCT3_ADD_SUB, FUNCT7_DEFAULT, rd, 0, rs2); // c.mv
+            }
+            if (rs2 == 0) { // c.jalr; c.ebreak (rd = 0) is not supported
+                return rd == 0 ? 0 : encodeI(OP_JALR, FUNCT3_JALR, 1, rd, 0);
+            }
+            return encodeR(OP_RTYPE, FUNCT3_ADD_SUB, FUNCT7_DEFAULT, rd, rd, rs2); // c.add
+        case 026: // c.swsp
+            return encodeS(FUNCT3_SW, 2, rs2, (field(c, 12, 9) << 2) | (field(c, 8, 7) << 6));
+        case 027: // c.sdsp
+            return encodeS(FUNCT3_SD, 2, rs2, (field(c, 12, 10) << 3) | (field(c, 9, 7) << 6));
+    }
+    // c.fld, c.fsd, c.fldsp, c.fsdsp, the reserved funct3 of quadrant 0 and quadrant 3
+    return 0;
+}
+
+static vector<uint32_t> buildExpansionTable() {
+    vector<uint32_t> table(1 << 16);
+    for (uint32_t c = 0; c < table.size(); c++) {
+        uint32_t expanded = expandParcel(c);
+        // an illegal parcel keeps its own bits, whose opcode is no 32-bit one
+        table[c] = expanded != 0 ? expanded : c;
+    }
+    return table;
+}
+
+uint32_t expandCompressed(uint16_t parcel) {
+    static const vector<uint32_t> table = buildExpansionTable();
+    return table[parcel];
+}
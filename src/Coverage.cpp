@@ -0,0 +1,365 @@
+#include "Coverage.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Pseudo-operations, which come first in the table: anything the lookup below
+// does not know is illegal.
+enum CoverageSpecialOp {
+    COVERAGE_OP_ILLEGAL = 0,
+    COVERAGE_OP_HALT,
+    COVERAGE_OP_NOP,
+    COVERAGE_OP_ECALL
+};
+
+#define ANY -1
+#define RD   COVERAGE_RD_ZERO
+#define RS   COVERAGE_RS1_IS_RS2
+#define IMM  COVERAGE_NEG_IMM
+#define SHMT COVERAGE_MAX_SHAMT
+
+struct CoverageOp {
+    const char *name;
+    int opcode;     // ANY for the pseudo-operations
+    int funct3;     // or ANY where the encoding has none
+    int funct7;     // as simDecode extracts it, or ANY where it is immediate bits
+    uint8_t classes; // the operand classes that apply
+};
+
+static const CoverageOp OPS[COVERAGE_OPS] = {
+    { "illegal", ANY, ANY, ANY, 0 },
+    { "halt",    ANY, ANY, ANY, 0 },
+    { "nop",     ANY, ANY, ANY, 0 },
+    { "ecall",   OP_SYSTEM, ANY, ANY, 0 },
+
+    { "addi",  OP_INTIMM, FUNCT3_ADD_SUB,  ANY, RD | IMM },
+    { "slti",  OP_INTIMM, FUNCT3_SLT,      ANY, RD | IMM },
+    { "sltiu", OP_INTIMM, FUNCT3_SLTU,     ANY, RD | IMM },
+    { "xori",  OP_INTIMM, FUNCT3_XOR,      ANY, RD | IMM },
+    { "ori",   OP_INTIMM, FUNCT3_OR,       ANY, RD | IMM },
+    { "andi",  OP_INTIMM, FUNCT3_AND,      ANY, RD | IMM },
+    { "slli",  OP_INTIMM, FUNCT3_SLL,      FUNCT7_DEFAULT, RD | SHMT },
+    { "srli",  OP_INTIMM, FUNCT3_SRL_SRA,  FUNCT7_DEFAULT, RD | SHMT },
+    { "srai",  OP_INTIMM, FUNCT3_SRL_SRA,  FUNCT7_SUB_SRA, RD | SHMT },
+
+    { "addiw", OP_INTIMMW, FUNCT3_ADD_SUB, ANY, RD | IMM },
+    { "slliw", OP_INTIMMW, FUNCT3_SLL,     FUNCT7_DEFAULT, RD | SHMT },
+    { "srliw", OP_INTIMMW, FUNCT3_SRL_SRA, FUNCT7_DEFAULT, RD | SHMT },
+    { "sraiw", OP_INTIMMW, FUNCT3_SRL_SRA, FUNCT7_SUB_SRA, RD | SHMT },
+
+    { "lb",  OP_LOAD, FUNCT3_LB,  ANY, RD | IMM },
+    { "lh",  OP_LOAD, FUNCT3_LH,  ANY, RD | IMM },
+    { "lw",  OP_LOAD, FUNCT3_LW,  ANY, RD | IMM },
+    { "ld",  OP_LOAD, FUNCT3_LD,  ANY, RD | IMM },
+    { "lbu", OP_LOAD, FUNCT3_LBU, ANY, RD | IMM },
+    { "lhu", OP_LOAD, FUNCT3_LHU, ANY, RD | IMM },
+    { "lwu", OP_LOAD, FUNCT3_LWU, ANY, RD | IMM },
+
+    { "add",  OP_RTYPE, FUNCT3_ADD_SUB, FUNCT7_DEFAULT, RD | RS },
+    { "sub",  OP_RTYPE, FUNCT3_ADD_SUB, FUNCT7_SUB_SRA, RD | RS },
+    { "sll",  OP_RTYPE, FUNCT3_SLL,     FUNCT7_DEFAULT, RD | RS },
+    { "slt",  OP_RTYPE, FUNCT3_SLT,     FUNCT7_DEFAULT, RD | RS },
+    { "sltu", OP_RTYPE, FUNCT3_SLTU,    FUNCT7_DEFAULT, RD | RS },
+    { "xor",  OP_RTYPE, FUNCT3_XOR,     FUNCT7_DEFAULT, RD | RS },
+    { "srl",  OP_RTYPE, FUNCT3_SRL_SRA, FUNCT7_DEFAULT, RD | RS },
+    { "sra",  OP_RTYPE, FUNCT3_SRL_SRA, FUNCT7_SUB_SRA, RD | RS },
+    { "or",   OP_RTYPE, FUNCT3_OR,      FUNCT7_DEFAULT, RD | RS },
+    { "and",  OP_RTYPE, FUNCT3_AND,     FUNCT7_DEFAULT, RD | RS },
+
+    { "mul",    OP_RTYPE, FUNCT3_MUL,    FUNCT7_MULDIV, RD | RS },
+    { "mulh",   OP_RTYPE, FUNCT3_MULH,   FUNCT7_MULDIV, RD | RS },
+    { "mulhsu", OP_RTYPE, FUNCT3_MULHSU, FUNCT7_MULDIV, RD | RS },
+    { "mulhu",  OP_RTYPE, FUNCT3_MULHU,  FUNCT7_MULDIV, RD | RS },
+    { "div",    OP_RTYPE, FUNCT3_DIV,    FUNCT7_MULDIV, RD | RS },
+    { "divu",   OP_RTYPE, FUNCT3_DIVU,   FUNCT7_MULDIV, RD | RS },
+    { "rem",    OP_RTYPE, FUNCT3_REM,    FUNCT7_MULDIV, RD | RS },
+    { "remu",   OP_RTYPE, FUNCT3_REMU,   FUNCT7_MULDIV, RD | RS },
+
+    { "addw", OP_RTYPEW, FUNCT3_ADD_SUB, FUNCT7_DEFAULT, RD | RS },
+    { "subw", OP_RTYPEW, FUNCT3_ADD_SUB, FUNCT7_SUB_SRA, RD | RS },
+    { "sllw", OP_RTYPEW, FUNCT3_SLL,     FUNCT7_DEFAULT, RD | RS },
+    { "srlw", OP_RTYPEW, FUNCT3_SRL_SRA, FUNCT7_DEFAULT, RD | RS },
+    { "sraw", OP_RTYPEW, FUNCT3_SRL_SRA, FUNCT7_SUB_SRA, RD | RS },
+
+    { "mulw",  OP_RTYPEW, FUNCT3_MUL,  FUNCT7_MULDIV, RD | RS },
+    { "divw",  OP_RTYPEW, FUNCT3_DIV,  FUNCT7_MULDIV, RD | RS },
+    { "divuw", OP_RTYPEW, FUNCT3_DIVU, FUNCT7_MULDIV, RD | RS },
+    { "remw",  OP_RTYPEW, FUNCT3_REM,  FUNCT7_MULDIV, RD | RS },
+    { "remuw", OP_RTYPEW, FUNCT3_REMU, FUNCT7_MULDIV, RD | RS },
+
+    { "sb", OP_STORE, FUNCT3_SB, ANY, RS | IMM },
+    { "sh", OP_STORE, FUNCT3_SH, ANY, RS | IMM },
+    { "sw", OP_STORE, FUNCT3_SW, ANY, RS | IMM },
+    { "sd", OP_STORE, FUNCT3_SD, ANY, RS | IMM },
+
+    { "beq",  OP_SBTYPE, FUNCT3_BEQ,  ANY, RS | IMM },
+    { "bne",  OP_SBTYPE, FUNCT3_BNE,  ANY, RS | IMM },
+    { "blt",  OP_SBTYPE, FUNCT3_BLT,  ANY, RS | IMM },
+    { "bge",  OP_SBTYPE, FUNCT3_BGE,  ANY, RS | IMM },
+    { "bltu", OP_SBTYPE, FUNCT3_BLTU, ANY, RS | IMM },
+    { "bgeu", OP_SBTYPE, FUNCT3_BGEU, ANY, RS | IMM },
+
+    { "lui",   OP_LUI,   ANY, ANY, RD | IMM },
+    { "auipc", OP_AUIPC, ANY, ANY, RD | IMM },
+    { "jal",   OP_JAL,   ANY, ANY, RD | IMM },
+    { "jalr",  OP_JALR,  FUNCT3_JALR, ANY, RD | IMM },
+};
+
+static const char *CLASS_NAMES[] = { "rd=x0", "rs1=rs2", "imm<0", "shamt=max" };
+
+// The funct7 values that tell operations apart; everything else is immediate
+// bits or illegal.
+static unsigned funct7Variant(uint64_t funct7) {
+    switch (funct7) {
+        case FUNCT7_DEFAULT: return 0;
+        case FUNCT7_SUB_SRA: return 1;
+        case FUNCT7_MULDIV:  return 2;
+    }
+    return 3;
+}
+
+// The operation of every opcode, funct3 and funct7 variant, built from OPS once.
+struct CoverageLookup {
+    uint8_t op[128][8][4];
+
+    CoverageLookup() {
+        memset(op, COVERAGE_OP_ILLEGAL, sizeof(op));
+        for (unsigned i = COVERAGE_OP_ECALL; i < COVERAGE_OPS; i++) {
+            for (unsigned f3 = 0; f3 < 8; f3++) {
+                for (unsigned v = 0; v < 4; v++) {
+                    if ((OPS[i].funct3 == ANY || OPS[i].funct3 == (int)f3) &&
+                        (OPS[i].funct7 == ANY || funct7Variant(OPS[i].funct7) == v)) {
+                        op[OPS[i].opcode][f3][v] = i;
+                    }
+                }
+            }
+        }
+    }
+};
+
+static const CoverageLookup &lookup() {
+    static const CoverageLookup table;
+    return table;
+}
+
+uint16_t coveragePoint(const Instruction &inst) {
+    unsigned op;
+    if (inst.isHalt) {
+        op = COVERAGE_OP_HALT;
+    }
+    else if (inst.isNop) {
+        op = COVERAGE_OP_NOP;
+    }
+    else if (!inst.isLegal) {
+        op = COVERAGE_OP_ILLEGAL;
+    }
+    else {
+        op = lookup().op[inst.opcode & 0x7f][inst.funct3 & 0x7][funct7Variant(inst.funct7)];
+    }
+
+    unsigned classes = OPS[op].classes;
+    unsigned point = 0;
+    if ((classes & COVERAGE_RD_ZERO) && inst.rd == 0) {
+        point |= COVERAGE_RD_ZERO;
+    }
+    if ((classes & COVERAGE_RS1_IS_RS2) && inst.rs1 == inst.rs2) {
+        point |= COVERAGE_RS1_IS_RS2;
+    }
+    if ((classes & COVERAGE_NEG_IMM) && inst.imm < 0) {
+        point |= COVERAGE_NEG_IMM;
+    }
+    if (classes & COVERAGE_MAX_SHAMT) {
+        uint64_t mask = inst.opcode == OP_INTIMMW ? 0x1f : 0x3f;
+        if (((inst.instruction >> 20) & mask) == mask) {
+            point |= COVERAGE_MAX_SHAMT;
+        }
+    }
+    return op * COVERAGE_CLASSES + point;
+}
+
+unsigned coverageOperation(uint32_t instruction) {
+    if (instruction == 0xfeedfeed) {
+        return COVERAGE_OP_HALT;
+    }
+    if (instruction == 0x00000013) {
+        return COVERAGE_OP_NOP;
+    }
+    uint32_t opcode = instruction & 0x7f;
+    // as simDecode extracts it: imm[5] of a 64-bit shift-immediate is shamt[5]
+    uint32_t funct7 = (instruction >> 25) & (opcode == OP_INTIMM ? 0x7e : 0x7f);
+    return lookup().op[opcode][(instruction >> 12) & 7][funct7Variant(funct7)];
+}
+
+const char *coverageOperationName(unsigned op) {
+    return op < COVERAGE_OPS ? OPS[op].name : "?";
+}
+
+// The layout of a coverage file: this header, then COVERAGE_WORDS words of bitmap.
+struct CoverageFileHeader {
+    char magic[8];   // COVERAGE_MAGIC
+    uint32_t version; // COVERAGE_VERSION
+    uint32_t points;  // COVERAGE_POINTS
+};
+
+Coverage::Coverage() {
+    memset(bits, 0, sizeof(bits));
+}
+
+void Coverage::merge(const Coverage &other) {
+    for (unsigned w = 0; w < COVERAGE_WORDS; w++) {
+        bits[w] |= other.bits[w];
+    }
+}
+
+// Reads the bitmap of the open coverage file fd into words. An empty file
+// reads as an empty bitmap.
+static bool readCoverage(int fd, const char *path, uint64_t *words) {
+    CoverageFileHeader header;
+    ssize_t got = pread(fd, &header, sizeof(header), 0);
+    if (got == 0) {
+        memset(words, 0, COVERAGE_WORDS * sizeof(uint64_t));
+        return true;
+    }
+    if (got != (ssize_t)sizeof(header) || memcmp(header.magic, COVERAGE_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "%s: not a coverage file\n", path);
+        return false;
+    }
+    if (header.version != COVERAGE_VERSION || header.points != COVERAGE_POINTS) {
+        fprintf(stderr, "%s: coverage version %u, this build reads version %u\n", path,
+                header.version, COVERAGE_VERSION);
+        return false;
+    }
+    size_t length = COVERAGE_WORDS * sizeof(uint64_t);
+    if (pread(fd, words, length, sizeof(header)) != (ssize_t)length) {
+        fprintf(stderr, "%s: coverage file is cut short\n", path);
+        return false;
+    }
+    return true;
+}
+
+bool Coverage::load(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    flock(fd, LOCK_SH);
+    bool ok = readCoverage(fd, path, bits);
+    close(fd);
+    return ok;
+}
+
+bool Coverage::mergeInto(const char *path) const {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    // held until close, so another run cannot write between the read and the write
+    if (flock(fd, LOCK_EX) != 0) {
+        perror(path);
+        close(fd);
+        return false;
+    }
+    uint64_t words[COVERAGE_WORDS];
+    if (!readCoverage(fd, path, words)) {
+        close(fd);
+        return false;
+    }
+    for (unsigned w = 0; w < COVERAGE_WORDS; w++) {
+        words[w] |= bits[w];
+    }
+
+    CoverageFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COVERAGE_MAGIC, sizeof(header.magic));
+    header.version = COVERAGE_VERSION;
+    header.points = COVERAGE_POINTS;
+    size_t length = sizeof(words);
+    bool ok = pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)
+           && pwrite(fd, words, length, sizeof(header)) == (ssize_t)length;
+    if (!ok) {
+        perror(path);
+    }
+    close(fd);
+    return ok;
+}
+
+// Writes the operand classes of point as "rd=x0+imm<0", or "plain" for none.
+static void printClasses(FILE *out, unsigned classes) {
+    if (classes == 0) {
+        fprintf(out, " plain");
+        return;
+    }
+    const char *separator = " ";
+    for (unsigned c = 0; c < 4; c++) {
+        if (classes & (1u << c)) {
+            fprintf(out, "%s%s", separator, CLASS_NAMES[c]);
+            separator = "+";
+        }
+    }
+}
+
+void Coverage::report(FILE *out) const {
+    unsigned legalPoints = 0, coveredPoints = 0, coveredOps = 0;
+    for (unsigned op = COVERAGE_OP_HALT; op < COVERAGE_OPS; op++) {
+        bool any = false;
+        for (unsigned classes = 0; classes < COVERAGE_CLASSES; classes++) {
+            if ((classes & ~OPS[op].classes) == 0) {
+                legalPoints++;
+                if (covered(op * COVERAGE_CLASSES + classes)) {
+                    coveredPoints++;
+                    any = true;
+                }
+            }
+        }
+        coveredOps += any;
+    }
+    fprintf(out, "coverage: %u of %u legal points (%.1f%%), %u of %u operations\n", coveredPoints,
+            legalPoints, 100.0 * coveredPoints / legalPoints, coveredOps, COVERAGE_OPS - 1);
+
+    // operations never executed, then the classes the others missed
+    fprintf(out, "never executed:");
+    unsigned column = 15;
+    for (unsigned op = COVERAGE_OP_HALT; op < COVERAGE_OPS; op++) {
+        bool any = false;
+        for (unsigned classes = 0; classes < COVERAGE_CLASSES && !any; classes++) {
+            any = covered(op * COVERAGE_CLASSES + classes);
+        }
+        if (!any) {
+            if (column + 1 + strlen(OPS[op].name) > 79) {
+                fprintf(out, "\n   ");
+                column = 3;
+            }
+            column += fprintf(out, " %s", OPS[op].name);
+        }
+    }
+    fprintf(out, "%s\n", coveredOps == COVERAGE_OPS - 1 ? " none" : "");
+
+    fprintf(out, "uncovered operand classes:\n");
+    for (unsigned op = COVERAGE_OP_HALT; op < COVERAGE_OPS; op++) {
+        unsigned missing = 0, total = 0;
+        for (unsigned classes = 0; classes < COVERAGE_CLASSES; classes++) {
+            if ((classes & ~OPS[op].classes) == 0) {
+                total++;
+                missing += !covered(op * COVERAGE_CLASSES + classes);
+            }
+        }
+        if (missing == 0 || missing == total) {
+            continue;
+        }
+        fprintf(out, "  %-8s", OPS[op].name);
+        for (unsigned classes = 0; classes < COVERAGE_CLASSES; classes++) {
+            if ((classes & ~OPS[op].classes) == 0 && !covered(op * COVERAGE_CLASSES + classes)) {
+                printClasses(out, classes);
+            }
+        }
+        fprintf(out, "\n");
+    }
+    fprintf(out, "illegal instructions: %s\n",
+            covered(COVERAGE_OP_ILLEGAL * COVERAGE_CLASSES) ? "executed" : "never executed");
+}
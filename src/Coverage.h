@@ -0,0 +1,72 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sim.h"
+
+// Bump whenever the operation table or the classes change, so that coverage
+// files recorded against another table are refused rather than misread.
+#define COVERAGE_VERSION 1
+#define COVERAGE_MAGIC "RVSIMCV"
+
+// Operand classes, one bit each, that split an operation into coverage points.
+// Only the classes an operation can have are counted as its legal encodings.
+#define COVERAGE_RD_ZERO    0x1 // rd is x0
+#define COVERAGE_RS1_IS_RS2 0x2 // both sources are the same register
+#define COVERAGE_NEG_IMM    0x4 // the immediate is negative
+#define COVERAGE_MAX_SHAMT  0x8 // a shift-immediate by 63 (31 for the W forms)
+#define COVERAGE_CLASSES    16
+
+// Decoded operations: every RV64IM instruction simDecode accepts (loads and
+// stores by size, so memory sizes have points of their own), plus nop, the halt
+// word and illegal instructions.
+#define COVERAGE_OPS 66
+#define COVERAGE_POINTS (COVERAGE_OPS * COVERAGE_CLASSES)
+#define COVERAGE_WORDS ((COVERAGE_POINTS + 63) / 64)
+
+// The coverage point of a decoded instruction: its operation times
+// COVERAGE_CLASSES plus the classes its operands fall in. simDecode stores it in
+// Instruction::coverage, so predecoded instructions carry it for free.
+uint16_t coveragePoint(const Instruction &inst);
+
+// The operation of an instruction word that simDecode accepts, numbered as in
+// coveragePoint, for classifying executed instructions from their bits alone.
+unsigned coverageOperation(uint32_t instruction);
+
+// The name of an operation, such as "addi", "nop" or "illegal".
+const char *coverageOperationName(unsigned op);
+
+// A bitmap of the coverage points executed. Simulator::step marks each executed
+// instruction, halts and illegal instructions included, with a single OR;
+// bitmaps of separate runs merge by OR-ing them together.
+class Coverage
+{
+    public:
+        Coverage();
+
+        void record(const Instruction &inst) {
+            bits[inst.coverage >> 6] |= 1ULL << (inst.coverage & 63);
+        }
+
+        bool covered(unsigned point) const { return (bits[point >> 6] >> (point & 63)) & 1; }
+        void merge(const Coverage &other);
+
+        // Reads a coverage file into this bitmap, replacing it. Returns false,
+        // having printed why, if path is not a coverage file of this version.
+        bool load(const char *path);
+
+        // ORs this bitmap into the coverage file at path, creating it if need be.
+        // The file is locked meanwhile, so runs side by side can share one file.
+        bool mergeInto(const char *path) const;
+
+        // Lists how many legal points are covered, the operations never executed
+        // and, for every other operation, the operand classes it never ran with.
+        void report(FILE *out) const;
+
+    private:
+        uint64_t bits[COVERAGE_WORDS];
+};
+
+#endif
@@ -0,0 +1,228 @@
+#include "Debugger.h"
+#include "StateDump.h"
+#include "Disassembler.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace std;
+
+// instructions run between checks while continuing
+static const uint64_t DEBUG_SLICE = 1 << 16;
+
+static const char *DEBUG_HELP =
+    "step [n]             execute n instructions (default 1)\n"
+    "continue             run until the program halts\n"
+    "reverse-step [n]     take back n instructions (default 1)\n"
+    "reverse-continue     go back as far as the undo log and checkpoints reach,\n"
+    "                     or the last breakpoint or watched store in the log\n"
+    "                     (going back stops at the last ecall)\n"
+    "last-write <addr>    go back to just before the last store to addr\n"
+    "break <addr>         stop before executing the instruction at addr\n"
+    "watch <addr> [bytes] stop after a store to addr (default 8 bytes)\n"
+    "delete <addr>        remove the breakpoint or watchpoint at addr\n"
+    "regs                 dump the registers\n"
+    "mem <addr> [bytes]   dump memory (default 20 bytes)\n"
+    "where                show the next instruction\n"
+    "quit\n";
+
+static vector<string> splitWords(const string &line) {
+    vector<string> words;
+    size_t start = line.find_first_not_of(" \t\r\n");
+    while (start != string::npos) {
+        size_t end = line.find_first_of(" \t\r\n", start);
+        words.push_back(line.substr(start, end - start));
+        start = end == string::npos ? end : line.find_first_not_of(" \t\r\n", end);
+    }
+    return words;
+}
+
+Debugger::Debugger(Simulator &sim, UndoLog *undo) : sim(sim), undo(undo) {
+    sim.setUndoLog(undo);
+}
+
+// The assembly text of the instruction at pc, compressed ones as the 32-bit
+// instruction they stand for.
+static const char *instructionAt(Simulator &sim, uint64_t pc, char *text) {
+    formatInstruction(simDecode(simFetch(pc, sim.getMemory())), text);
+    return text;
+}
+
+void Debugger::printLocation() {
+    char text[DISASM_TEXT_MAX];
+    const char *state = sim.getStatus() == SIM_HALTED ? " (halted)" :
+                        sim.getStatus() == SIM_ILLEGAL ? " (illegal instruction)" : "";
+    printf("0x%08lx after %lu instructions%s: %s\n", sim.getPC(), sim.getInstructionCount(), state,
+           instructionAt(sim, sim.getPC(), text));
+}
+
+void Debugger::printStop(const char *reason, uint64_t pc) {
+    char instruction[DISASM_TEXT_MAX];
+    printf("%s, by 0x%08lx: %s\n", reason, pc, instructionAt(sim, pc, instruction));
+    printLocation();
+    string text;
+    formatRegisterState(sim.getRegisters(), text);
+    fwrite(text.data(), 1, text.size(), stdout);
+}
+
+void Debugger::forward(uint64_t maxInstructions) {
+    // continuing from a breakpoint, however it was reached, executes it
+    sim.skipBreakpoint();
+    SimStatus status = sim.getStatus();
+    for (uint64_t done = 0; done < maxInstructions; ) {
+        uint64_t slice = maxInstructions - done < DEBUG_SLICE ? maxInstructions - done : DEBUG_SLICE;
+        uint64_t before = sim.getInstructionCount();
+        status = sim.run(slice);
+        done += sim.getInstructionCount() - before;
+        if (status != SIM_RUNNING) {
+            break;
+        }
+    }
+
+    char reason[64];
+    if (status == SIM_BREAKPOINT) {
+        printStop("breakpoint", sim.getPC());
+    }
+    else if (status == SIM_WATCHPOINT) {
+        const Instruction &store = sim.getLastInstruction();
+        snprintf(reason, sizeof(reason), "watchpoint: %d-byte store to 0x%lx", 1 << (store.funct3 & 3),
+                 store.memAddress);
+        printStop(reason, store.PC);
+    }
+    else {
+        printLocation();
+    }
+}
+
+void Debugger::reverseContinue() {
+    while (undo->size() > 0) {
+        UndoRecord r = *undo->last();
+        undo->stepBack(sim, 1);
+        if (r.kind == UNDO_STORE && sim.isWatched(r.address, r.size)) {
+            char reason[64];
+            snprintf(reason, sizeof(reason), "before watchpoint: %u-byte store to 0x%lx", r.size, r.address);
+            printStop(reason, r.pc);
+            return;
+        }
+        if (sim.hasBreakpoint(sim.getPC())) {
+            printStop("breakpoint", sim.getPC());
+            return;
+        }
+    }
+    // breakpoints beyond the log are not looked for; go back to the first checkpoint
+    undo->stepBack(sim, sim.getInstructionCount());
+    printLocation();
+}
+
+bool Debugger::needUndo() {
+    if (undo == NULL) {
+        printf("reverse execution needs the undo log (--undo-log)\n");
+        return false;
+    }
+    return true;
+}
+
+bool Debugger::execute(const string &line) {
+    vector<string> words = splitWords(line);
+    if (words.empty()) {
+        return true;
+    }
+    const string &cmd = words[0];
+    uint64_t arg = words.size() > 1 ? strtoull(words[1].c_str(), NULL, 0) : 1;
+
+    if (cmd == "quit" || cmd == "q") {
+        return false;
+    }
+    else if (cmd == "step" || cmd == "s") {
+        forward(arg);
+    }
+    else if (cmd == "continue" || cmd == "c") {
+        forward(UINT64_MAX);
+    }
+    else if (cmd == "reverse-step" || cmd == "rs") {
+        if (needUndo()) {
+            uint64_t back = undo->stepBack(sim, arg);
+            if (back < arg) {
+                bool syscall = undo->getBarrier() > 0 && sim.getInstructionCount() == undo->getBarrier();
+                printf("only %lu instructions could be taken back%s\n", back,
+                       syscall ? ", not past the last system call" : "");
+            }
+            printLocation();
+        }
+    }
+    else if (cmd == "reverse-continue" || cmd == "rc") {
+        if (needUndo()) {
+            reverseContinue();
+        }
+    }
+    else if (cmd == "last-write" && words.size() > 1) {
+        UndoRecord store;
+        if (needUndo()) {
+            if (undo->backToLastWrite(sim, arg, store)) {
+                printf("%u-byte store to 0x%lx, replacing 0x%lx\n", store.size, store.address, store.oldValue);
+                printLocation();
+            }
+            else {
+                printf("no store to 0x%lx in the last %lu instructions\n", arg, undo->size());
+            }
+        }
+    }
+    else if ((cmd == "break" || cmd == "b") && words.size() > 1) {
+        sim.addBreakpoint(arg);
+        printf("breakpoint at 0x%lx\n", arg);
+    }
+    else if (cmd == "watch" && words.size() > 1) {
+        uint64_t bytes = words.size() > 2 ? strtoull(words[2].c_str(), NULL, 0) : 8;
+        if (sim.addWatchpoint(arg, bytes)) {
+            printf("watchpoint on [0x%lx, 0x%lx)\n", arg, arg + bytes);
+        }
+        else {
+            printf("cannot watch [0x%lx, 0x%lx)\n", arg, arg + bytes);
+        }
+    }
+    else if (cmd == "delete" && words.size() > 1) {
+        bool removed = sim.removeBreakpoint(arg);
+        removed = sim.removeWatchpoint(arg) || removed;
+        if (!removed) {
+            printf("no breakpoint or watchpoint at 0x%lx\n", arg);
+        }
+    }
+    else if (cmd == "regs") {
+        string text;
+        formatRegisterState(sim.getRegisters(), text);
+        fwrite(text.data(), 1, text.size(), stdout);
+    }
+    else if (cmd == "mem" && words.size() > 1) {
+        uint64_t bytes = words.size() > 2 ? strtoull(words[2].c_str(), NULL, 0) : 20;
+        string text;
+        formatMemoryRange(sim.getMemory(), arg, arg + bytes, text);
+        fwrite(text.data(), 1, text.size(), stdout);
+    }
+    else if (cmd == "where" || cmd == "w") {
+        printLocation();
+    }
+    else if (cmd == "help" || cmd == "h") {
+        fputs(DEBUG_HELP, stdout);
+    }
+    else {
+        printf("unknown command '%s'; try help\n", cmd.c_str());
+    }
+    fflush(stdout);
+    return true;
+}
+
+SimStatus Debugger::run(FILE *in) {
+    bool interactive = isatty(fileno(in));
+    char line[256];
+    while (true) {
+        if (interactive) {
+            printf("(sim) ");
+            fflush(stdout);
+        }
+        if (fgets(line, sizeof(line), in) == NULL || !execute(line)) {
+            break;
+        }
+    }
+    return sim.getStatus();
+}
@@ -0,0 +1,38 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "Simulator.h"
+#include "UndoLog.h"
+
+// A command line for stepping a Simulator forwards and, with an UndoLog attached,
+// backwards. Commands are read one per line; "help" lists them. Running stops at
+// breakpoints and watchpoints, printing the registers.
+class Debugger
+{
+    public:
+        // undo may be NULL, which disables the reverse commands.
+        Debugger(Simulator &sim, UndoLog *undo);
+
+        // Executes commands from in until quit or the end of input, prompting
+        // when in is a terminal. Returns the simulator's status.
+        SimStatus run(FILE *in);
+
+        // Executes one command line; false on quit.
+        bool execute(const std::string &line);
+
+    private:
+        void printLocation();
+        void printStop(const char *reason, uint64_t pc);
+        void forward(uint64_t maxInstructions);
+        void reverseContinue();
+        bool needUndo();
+
+        Simulator &sim;
+        UndoLog *undo;
+};
+
+#endif
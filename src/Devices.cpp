@@ -0,0 +1,202 @@
+#include "Devices.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+
+using namespace std;
+
+HostOutput::HostOutput(int fd) : fd(fd), capture(NULL), captureLimit(0) {
+    buffer.reserve(HOST_OUTPUT_BUFFER);
+}
+
+HostOutput::HostOutput(string &capture, size_t limit) : fd(-1), capture(&capture), captureLimit(limit) {
+    buffer.reserve(HOST_OUTPUT_BUFFER);
+}
+
+HostOutput::~HostOutput() {
+    flush();
+}
+
+void HostOutput::write(const uint8_t *data, size_t length) {
+    buffer.insert(buffer.end(), data, data + length);
+    if (buffer.size() >= HOST_OUTPUT_BUFFER) {
+        flush();
+    }
+}
+
+bool HostOutput::flush() {
+    if (capture != NULL && capture->size() < captureLimit) {
+        capture->append(buffer.begin(), buffer.begin() + min(buffer.size(), captureLimit - capture->size()));
+    }
+    if (fd < 0) {
+        buffer.clear();
+        return true;
+    }
+    size_t done = 0;
+    while (done < buffer.size()) {
+        ssize_t n = ::write(fd, buffer.data() + done, buffer.size() - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            perror("guest output");
+            buffer.clear();
+            return false;
+        }
+        done += n;
+    }
+    buffer.clear();
+    return true;
+}
+
+void EventScheduler::schedule(uint64_t when, Device *device) {
+    Event e = { when, scheduled++, device };
+    events.push(e);
+    next = events.top().when;
+}
+
+void EventScheduler::runDue(uint64_t now) {
+    while (!events.empty() && events.top().when <= now) {
+        Device *device = events.top().device;
+        events.pop();
+        // the device may schedule again from here
+        next = events.empty() ? UINT64_MAX : events.top().when;
+        device->event(now);
+    }
+    next = events.empty() ? UINT64_MAX : events.top().when;
+}
+
+void EventScheduler::clear() {
+    events = priority_queue<Event>();
+    next = UINT64_MAX;
+}
+
+void DeviceBus::map(uint64_t base, uint64_t size, Device *device) {
+    Mapping m = { base, size, device };
+    mappings.push_back(m);
+}
+
+Device *DeviceBus::find(uint64_t address, MemEntrySize size, uint64_t &offset) {
+    for (size_t i = 0; i < mappings.size(); i++) {
+        if (address >= mappings[i].base && address - mappings[i].base + size <= mappings[i].size) {
+            offset = address - mappings[i].base;
+            return mappings[i].device;
+        }
+    }
+    return NULL;
+}
+
+bool DeviceBus::read(uint64_t address, uint64_t &value, MemEntrySize size) {
+    uint64_t offset;
+    Device *device = find(address, size, offset);
+    if (device == NULL) {
+        return false;
+    }
+    value = device->read(offset, size);
+    return true;
+}
+
+bool DeviceBus::write(uint64_t address, uint64_t value, MemEntrySize size) {
+    uint64_t offset;
+    Device *device = find(address, size, offset);
+    if (device == NULL) {
+        return false;
+    }
+    device->write(offset, value, size);
+    return true;
+}
+
+void DeviceBus::reset() {
+    scheduler.clear();
+    for (size_t i = 0; i < mappings.size(); i++) {
+        mappings[i].device->reset();
+    }
+}
+
+void DeviceBus::flush() {
+    for (size_t i = 0; i < mappings.size(); i++) {
+        mappings[i].device->flush();
+    }
+}
+
+uint64_t Uart::read(uint64_t offset, MemEntrySize size) {
+    return offset == UART_LSR ? UART_LSR_THR_EMPTY | UART_LSR_IDLE : 0;
+}
+
+void Uart::write(uint64_t offset, uint64_t value, MemEntrySize size) {
+    if (offset != UART_THR) {
+        return;
+    }
+    out.put((uint8_t)value);
+    if (!flushPending) {
+        bus.getScheduler().schedule(bus.now() + UART_FLUSH_INTERVAL, this);
+        flushPending = true;
+    }
+}
+
+void Uart::event(uint64_t now) {
+    out.flush();
+    flushPending = false;
+}
+
+// The timer's registers are 64 bits wide but may be accessed in parts.
+static uint64_t registerPart(uint64_t reg, uint64_t offset, MemEntrySize size) {
+    uint64_t part = reg >> ((offset & 7) * 8);
+    return size == DOUBLE_SIZE ? part : part & ((1ULL << (size * 8)) - 1);
+}
+
+static uint64_t withPart(uint64_t reg, uint64_t offset, uint64_t value, MemEntrySize size) {
+    unsigned shift = (offset & 7) * 8;
+    uint64_t mask = size == DOUBLE_SIZE ? ~0ULL : ((1ULL << (size * 8)) - 1) << shift;
+    return (reg & ~mask) | ((value << shift) & mask);
+}
+
+uint64_t Timer::read(uint64_t offset, MemEntrySize size) {
+    uint64_t reg = 0;
+    switch (offset & ~7ULL) {
+        case TIMER_MTIME:    reg = bus.now(); break;
+        case TIMER_MTIMECMP: reg = compare; break;
+        case TIMER_PERIOD:   reg = period; break;
+        case TIMER_FIRED:    reg = fired; break;
+    }
+    return registerPart(reg, offset, size);
+}
+
+void Timer::write(uint64_t offset, uint64_t value, MemEntrySize size) {
+    switch (offset & ~7ULL) {
+        case TIMER_MTIMECMP:
+            compare = withPart(compare, offset, value, size);
+            if (compare == UINT64_MAX) {
+                break;
+            }
+            // one past the current instruction at the soonest, which is still executing
+            bus.getScheduler().schedule(compare > bus.now() ? compare : bus.now() + 1, this);
+            break;
+        case TIMER_PERIOD:
+            period = withPart(period, offset, value, size);
+            break;
+        case TIMER_FIRED:
+            fired = 0;
+            break;
+    }
+}
+
+void Timer::event(uint64_t now) {
+    // left over from before mtimecmp was last written
+    if (now < compare) {
+        return;
+    }
+    fired++;
+    if (period == 0) {
+        compare = UINT64_MAX;
+        return;
+    }
+    compare += period;
+    if (compare <= now) {
+        // fell behind by whole periods; they are not made up
+        compare = now + period;
+    }
+    bus.getScheduler().schedule(compare, this);
+}
@@ -0,0 +1,196 @@
+#ifndef DEVICES_H
+#define DEVICES_H
+
+#include <stdint.h>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "sim.h"
+
+// Where the devices sit, outside RAM so that RAM accesses never look for them.
+#define UART_BASE  0x10000000
+#define UART_SIZE  0x100
+#define TIMER_BASE 0x10001000
+#define TIMER_SIZE 0x100
+
+// Bytes buffered before HostOutput writes them out.
+#define HOST_OUTPUT_BUFFER 4096
+// Instructions between flushes of UART output, so it shows up while a long run is going.
+#define UART_FLUSH_INTERVAL (1 << 22)
+
+// Output to a host file descriptor, collected and written in bulk. A negative
+// descriptor discards the output.
+class HostOutput
+{
+    public:
+        explicit HostOutput(int fd);
+        // Appends the output to capture instead, up to limit bytes; the rest is
+        // dropped.
+        HostOutput(std::string &capture, size_t limit);
+        ~HostOutput();
+
+        void put(uint8_t c) {
+            buffer.push_back(c);
+            if (buffer.size() >= HOST_OUTPUT_BUFFER) {
+                flush();
+            }
+        }
+        void write(const uint8_t *data, size_t length);
+        bool flush();
+        bool empty() const { return buffer.empty(); }
+
+    private:
+        int fd;
+        std::string *capture;
+        size_t captureLimit;
+        std::vector<uint8_t> buffer;
+};
+
+// A memory-mapped device. Offsets are relative to the base it is mapped at, and
+// accesses never cross the end of its range.
+class Device
+{
+    public:
+        virtual ~Device() {}
+
+        virtual uint64_t read(uint64_t offset, MemEntrySize size) = 0;
+        virtual void write(uint64_t offset, uint64_t value, MemEntrySize size) = 0;
+
+        // An event the device scheduled is due; now is the instruction count.
+        virtual void event(uint64_t now) {}
+
+        // Back to the power-on state, on a load or reset of the simulator.
+        virtual void reset() {}
+
+        // Pushes out anything buffered, at the end of a run.
+        virtual void flush() {}
+};
+
+// Device events in instruction count order. Simulator::run executes uninterrupted
+// blocks of instructions up to nextTime() and then lets the due devices act.
+class EventScheduler
+{
+    public:
+        EventScheduler() : next(UINT64_MAX), scheduled(0) {}
+
+        // Calls device->event at instruction count when. A device that reprograms
+        // itself leaves the old event in the queue and ignores it when it comes.
+        void schedule(uint64_t when, Device *device);
+
+        // Runs every event due at or before now, in order.
+        void runDue(uint64_t now);
+
+        // Instruction count of the earliest event, UINT64_MAX if there is none.
+        uint64_t nextTime() const { return next; }
+
+        void clear();
+
+    private:
+        struct Event {
+            uint64_t when;
+            uint64_t order; // keeps events at the same time in scheduling order
+            Device *device;
+            bool operator<(const Event &other) const {
+                return when != other.when ? when > other.when : order > other.order;
+            }
+        };
+
+        std::priority_queue<Event> events;
+        uint64_t next;
+        uint64_t scheduled;
+};
+
+// The devices of one simulator and the addresses they answer to. PagedMemoryStore
+// hands it the accesses outside RAM, so RAM runs at full speed.
+class DeviceBus
+{
+    public:
+        DeviceBus() : clock(NULL) {}
+
+        // Maps device (the caller keeps ownership) at [base, base + size).
+        void map(uint64_t base, uint64_t size, Device *device);
+
+        // False if nothing is mapped over the whole access.
+        bool read(uint64_t address, uint64_t &value, MemEntrySize size);
+        bool write(uint64_t address, uint64_t value, MemEntrySize size);
+
+        EventScheduler &getScheduler() { return scheduler; }
+
+        // The simulator's instruction count, which devices read as the time.
+        void setClock(const uint64_t *count) { clock = count; }
+        uint64_t now() const { return clock != NULL ? *clock : 0; }
+
+        void reset();
+        void flush();
+
+    private:
+        struct Mapping {
+            uint64_t base;
+            uint64_t size;
+            Device *device;
+        };
+
+        Device *find(uint64_t address, MemEntrySize size, uint64_t &offset);
+
+        std::vector<Mapping> mappings;
+        EventScheduler scheduler;
+        const uint64_t *clock;
+};
+
+// Register offsets of the UART, a subset of a 16550.
+#define UART_THR 0 // write: transmit a byte; read: receive buffer, always 0
+#define UART_LSR 5 // line status
+
+#define UART_LSR_THR_EMPTY 0x20
+#define UART_LSR_IDLE      0x40
+
+// A transmit-only UART. Bytes written go to a HostOutput, which is flushed when
+// full, every UART_FLUSH_INTERVAL instructions and at the end of the run.
+class Uart : public Device
+{
+    public:
+        Uart(DeviceBus &bus, HostOutput &out) : bus(bus), out(out), flushPending(false) {}
+
+        uint64_t read(uint64_t offset, MemEntrySize size) override;
+        void write(uint64_t offset, uint64_t value, MemEntrySize size) override;
+        void event(uint64_t now) override;
+        void reset() override { flushPending = false; }
+        void flush() override { out.flush(); }
+
+    private:
+        DeviceBus &bus;
+        HostOutput &out;
+        bool flushPending;
+};
+
+// Register offsets of the timer, all 64 bits wide.
+#define TIMER_MTIME    0x00 // read: instructions executed so far
+#define TIMER_MTIMECMP 0x08 // the timer fires once mtime reaches this
+#define TIMER_PERIOD   0x10 // if not 0, mtimecmp advances by this on every firing
+#define TIMER_FIRED    0x18 // read: firings so far; write: clears them
+
+// A timer counting executed instructions. There are no interrupts, so a program
+// sees it fire through TIMER_FIRED.
+class Timer : public Device
+{
+    public:
+        explicit Timer(DeviceBus &bus) : bus(bus) { reset(); }
+
+        uint64_t read(uint64_t offset, MemEntrySize size) override;
+        void write(uint64_t offset, uint64_t value, MemEntrySize size) override;
+        void event(uint64_t now) override;
+        void reset() override {
+            compare = UINT64_MAX;
+            period = 0;
+            fired = 0;
+        }
+
+    private:
+        DeviceBus &bus;
+        uint64_t compare;
+        uint64_t period;
+        uint64_t fired;
+};
+
+#endif
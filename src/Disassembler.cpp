@@ -0,0 +1,339 @@
+#include "Disassembler.h"
+#include "SymbolTable.h"
+
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+
+static const char *const REG_NAMES[REG_SIZE] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"
+};
+
+// Mnemonics by funct3; NULL where simDecode finds the instruction illegal.
+static const char *const LOAD_NAMES[8]    = { "lb", "lh", "lw", "ld", "lbu", "lhu", "lwu", NULL };
+static const char *const STORE_NAMES[8]   = { "sb", "sh", "sw", "sd", NULL, NULL, NULL, NULL };
+static const char *const BRANCH_NAMES[8]  = { "beq", "bne", NULL, NULL, "blt", "bge", "bltu", "bgeu" };
+static const char *const INTIMM_NAMES[8]  = { "addi", "slli", "slti", "sltiu", "xori", "srli", "ori", "andi" };
+static const char *const INTIMMW_NAMES[8] = { "addiw", "slliw", NULL, NULL, NULL, "srliw", NULL, NULL };
+static const char *const RTYPE_NAMES[8]   = { "add", "sll", "slt", "sltu", "xor", "srl", "or", "and" };
+static const char *const RTYPEW_NAMES[8]  = { "addw", "sllw", NULL, NULL, NULL, "srlw", NULL, NULL };
+static const char *const MULDIV_NAMES[8]  = { "mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu" };
+static const char *const MULDIVW_NAMES[8] = { "mulw", NULL, NULL, NULL, "divw", "divuw", "remw", "remuw" };
+
+// Kinds of entry in a listing's per-parcel marks.
+enum ParcelMark {
+    MARK_NONE = 0,
+    MARK_START,  // an instruction starts here
+    MARK_BLOCK,  // ... and a basic block, after a branch or jump
+    MARK_TARGET  // ... and a basic block that a branch or jump goes to, or the entry
+};
+
+static char *put(char *p, const char *s) {
+    while (*s != '\0') {
+        *p++ = *s++;
+    }
+    return p;
+}
+
+static char *putDecimal(char *p, int64_t value) {
+    char digits[24];
+    int n = 0;
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    do {
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        *p++ = '-';
+    }
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+// value in at least width hex digits, without a prefix
+static char *putHex(char *p, uint64_t value, int width) {
+    static const char HEX[] = "0123456789abcdef";
+    int digits = 1;
+    while (digits < 16 && (value >> (4 * digits)) != 0) {
+        digits++;
+    }
+    for (int i = max(digits, width) - 1; i >= 0; i--) {
+        *p++ = HEX[(value >> (4 * i)) & 15];
+    }
+    return p;
+}
+
+static char *putReg(char *p, uint64_t reg) {
+    return put(p, REG_NAMES[reg % REG_SIZE]);
+}
+
+static char *putSeparator(char *p) {
+    *p++ = ',';
+    *p++ = ' ';
+    return p;
+}
+
+// "imm(rs1)"
+static char *putAddress(char *p, int64_t imm, uint64_t rs1) {
+    p = putDecimal(p, imm);
+    *p++ = '(';
+    p = putReg(p, rs1);
+    *p++ = ')';
+    return p;
+}
+
+static const char *mnemonic(const Instruction &inst) {
+    switch (inst.opcode) {
+        case OP_LOAD:    return LOAD_NAMES[inst.funct3];
+        case OP_STORE:   return STORE_NAMES[inst.funct3];
+        case OP_SBTYPE:  return BRANCH_NAMES[inst.funct3];
+        case OP_INTIMM:
+            return inst.funct3 == FUNCT3_SRL_SRA && inst.funct7 == FUNCT7_SUB_SRA ? "srai" : INTIMM_NAMES[inst.funct3];
+        case OP_INTIMMW:
+            return inst.funct3 == FUNCT3_SRL_SRA && inst.funct7 == FUNCT7_SUB_SRA ? "sraiw" : INTIMMW_NAMES[inst.funct3];
+        case OP_RTYPE:
+            if (inst.funct7 == FUNCT7_MULDIV) {
+                return MULDIV_NAMES[inst.funct3];
+            }
+            if (inst.funct7 == FUNCT7_SUB_SRA) {
+                return inst.funct3 == FUNCT3_ADD_SUB ? "sub" : "sra";
+            }
+            return RTYPE_NAMES[inst.funct3];
+        case OP_RTYPEW:
+            if (inst.funct7 == FUNCT7_MULDIV) {
+                return MULDIVW_NAMES[inst.funct3];
+            }
+            if (inst.funct7 == FUNCT7_SUB_SRA) {
+                return inst.funct3 == FUNCT3_ADD_SUB ? "subw" : "sraw";
+            }
+            return RTYPEW_NAMES[inst.funct3];
+        case OP_LUI:     return "lui";
+        case OP_AUIPC:   return "auipc";
+        case OP_JAL:     return "jal";
+        case OP_JALR:    return "jalr";
+        case OP_SYSTEM:  return "ecall";
+    }
+    return NULL;
+}
+
+const char *instructionMnemonic(const Instruction &inst) {
+    const char *name = inst.isLegal ? mnemonic(inst) : NULL;
+    if (inst.isHalt) {
+        return "HALT";
+    }
+    if (inst.isNop) {
+        return "NOP";
+    }
+    return name != NULL ? name : "ILLEGAL";
+}
+
+size_t formatInstruction(const Instruction &inst, char *out) {
+    const char *name = inst.isLegal ? mnemonic(inst) : NULL;
+    char *p = out;
+    if (inst.isHalt || inst.isNop || name == NULL) {
+        p = put(p, instructionMnemonic(inst));
+    }
+    else {
+        p = put(p, name);
+        *p++ = ' ';
+        switch (inst.opcode) {
+            case OP_LOAD:
+                p = putSeparator(putReg(p, inst.rd));
+                p = putAddress(p, inst.imm, inst.rs1);
+                break;
+            case OP_STORE:
+                p = putSeparator(putReg(p, inst.rs2));
+                p = putAddress(p, inst.imm, inst.rs1);
+                break;
+            case OP_SBTYPE:
+                p = putSeparator(putReg(p, inst.rs1));
+                p = putSeparator(putReg(p, inst.rs2));
+                p = putHex(put(p, "0x"), inst.PC + inst.imm, 1);
+                break;
+            case OP_INTIMM:
+            case OP_INTIMMW:
+                p = putSeparator(putReg(p, inst.rd));
+                p = putSeparator(putReg(p, inst.rs1));
+                if (inst.funct3 == FUNCT3_SLL || inst.funct3 == FUNCT3_SRL_SRA) {
+                    p = putDecimal(p, inst.imm & (inst.opcode == OP_INTIMM ? 63 : 31));
+                }
+                else {
+                    p = putDecimal(p, inst.imm);
+                }
+                break;
+            case OP_RTYPE:
+            case OP_RTYPEW:
+                p = putSeparator(putReg(p, inst.rd));
+                p = putSeparator(putReg(p, inst.rs1));
+                p = putReg(p, inst.rs2);
+                break;
+            case OP_LUI:
+            case OP_AUIPC:
+                p = putSeparator(putReg(p, inst.rd));
+                p = putHex(put(p, "0x"), ((uint64_t)inst.imm >> 12) & 0xfffff, 1);
+                break;
+            case OP_JAL:
+                p = putSeparator(putReg(p, inst.rd));
+                p = putHex(put(p, "0x"), inst.PC + inst.imm, 1);
+                break;
+            case OP_JALR:
+                p = putSeparator(putReg(p, inst.rd));
+                p = putAddress(p, inst.imm, inst.rs1);
+                break;
+            default: // ecall
+                p--;
+                break;
+        }
+    }
+    *p = '\0';
+    return p - out;
+}
+
+// 32 bits at address, zero padded past the end of the image as in memory
+static uint32_t wordAt(const vector<uint8_t> &image, uint64_t address) {
+    uint32_t word = 0;
+    for (int i = 0; i < 4 && address + i < image.size(); i++) {
+        word |= (uint32_t)image[address + i] << (8 * i);
+    }
+    return word;
+}
+
+// A program image taken apart for listing, shared by the threads formatting it.
+struct Listing {
+    const vector<uint8_t> *image;
+    vector<Instruction> decoded;
+    vector<uint8_t> marks; // ParcelMark per 2-byte parcel
+    const SymbolTable *symbols;
+
+    uint8_t markAt(uint64_t address) const {
+        return (address & 1) == 0 && (address >> 1) < marks.size() ? marks[address >> 1] : MARK_NONE;
+    }
+};
+
+// The label of a block start: its symbol, if one starts there, or L<address>.
+static char *putLabel(char *p, const Listing &listing, uint64_t address) {
+    const SymbolTable::Symbol *symbol = listing.symbols != NULL ? listing.symbols->find(address) : NULL;
+    if (symbol != NULL && symbol->address == address) {
+        size_t length = min(symbol->name.size(), (size_t)DISASM_NAME_MAX);
+        memcpy(p, symbol->name.data(), length);
+        return p + length;
+    }
+    *p++ = 'L';
+    return putHex(p, address, 1);
+}
+
+static bool transfersControl(const Instruction &inst) {
+    return inst.isHalt || (inst.isLegal && (inst.opcode == OP_SBTYPE || inst.opcode == OP_JAL || inst.opcode == OP_JALR));
+}
+
+static bool hasTarget(const Instruction &inst) {
+    return inst.isLegal && (inst.opcode == OP_SBTYPE || inst.opcode == OP_JAL);
+}
+
+// Formats instructions [first, last) of listing into out, which has room for
+// DISASM_LINE_MAX bytes per instruction.
+static void formatRange(const Listing &listing, size_t first, size_t last, vector<char> &out) {
+    out.resize((last - first) * DISASM_LINE_MAX);
+    char *p = out.data();
+    for (size_t i = first; i < last; i++) {
+        const Instruction &inst = listing.decoded[i];
+        uint8_t mark = listing.markAt(inst.PC);
+        if (mark != MARK_START && inst.PC != 0) {
+            *p++ = '\n';
+        }
+        if (mark == MARK_TARGET) {
+            p = putHex(p, inst.PC, 8);
+            p = put(p, " <");
+            p = putLabel(p, listing, inst.PC);
+            p = put(p, ">:\n");
+        }
+
+        p = put(p, "  ");
+        p = putHex(p, inst.PC, 8);
+        p = put(p, ":  ");
+        // the raw bits, not the expansion of a compressed instruction
+        uint32_t raw = wordAt(*listing.image, inst.PC);
+        p = putHex(p, inst.length == 2 ? raw & 0xffff : raw, inst.length == 2 ? 4 : 8);
+        p = put(p, inst.length == 2 ? "      " : "  ");
+        p += formatInstruction(inst, p);
+        if (hasTarget(inst) && listing.markAt(inst.PC + inst.imm) == MARK_TARGET) {
+            p = put(p, " <");
+            p = putLabel(p, listing, inst.PC + inst.imm);
+            *p++ = '>';
+        }
+        *p++ = '\n';
+    }
+    out.resize(p - out.data());
+}
+
+bool disassembleImage(const vector<uint8_t> &image, FILE *out, unsigned threads, const SymbolTable *symbols) {
+    Listing listing;
+    listing.image = &image;
+    listing.symbols = symbols;
+    listing.marks.assign((image.size() + 1) / 2, MARK_NONE);
+
+    // Instruction boundaries depend on the lengths before them, so they are
+    // found in one cheap sequential sweep before the work is split.
+    vector<uint64_t> starts;
+    starts.reserve(image.size() / 2);
+    for (uint64_t pc = 0; pc < image.size(); ) {
+        uint32_t word = wordAt(image, pc);
+        starts.push_back(pc);
+        listing.marks[pc >> 1] = MARK_START;
+        pc += (word & 3) != 3 && word != 0xfeedfeed ? 2 : 4;
+    }
+
+    size_t count = starts.size();
+    unsigned workers = (unsigned)max<size_t>(1, min<size_t>(threads, count / DISASM_MIN_PER_THREAD));
+    vector<size_t> bounds(workers + 1);
+    for (unsigned w = 0; w <= workers; w++) {
+        bounds[w] = count * w / workers;
+    }
+    vector<thread> pool;
+
+    listing.decoded.resize(count);
+    for (unsigned w = 0; w < workers; w++) {
+        pool.push_back(thread([&, w] {
+            for (size_t i = bounds[w]; i < bounds[w + 1]; i++) {
+                listing.decoded[i] = simDecode(simFetchWord(starts[i], wordAt(image, starts[i])));
+            }
+        }));
+    }
+    for (size_t t = 0; t < pool.size(); t++) {
+        pool[t].join();
+    }
+    pool.clear();
+
+    // blocks start at the entry, at branch and jump targets and after them
+    if (!listing.marks.empty()) {
+        listing.marks[0] = MARK_TARGET;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const Instruction &inst = listing.decoded[i];
+        if (hasTarget(inst) && listing.markAt(inst.PC + inst.imm) != MARK_NONE) {
+            listing.marks[(inst.PC + inst.imm) >> 1] = MARK_TARGET;
+        }
+        if (transfersControl(inst) && listing.markAt(inst.PC + inst.length) == MARK_START) {
+            listing.marks[(inst.PC + inst.length) >> 1] = MARK_BLOCK;
+        }
+    }
+
+    vector<vector<char> > text(workers);
+    for (unsigned w = 0; w < workers; w++) {
+        pool.push_back(thread([&, w] { formatRange(listing, bounds[w], bounds[w + 1], text[w]); }));
+    }
+    for (size_t t = 0; t < pool.size(); t++) {
+        pool[t].join();
+    }
+    for (unsigned w = 0; w < workers; w++) {
+        if (fwrite(text[w].data(), 1, text[w].size(), out) != text[w].size()) {
+            return false;
+        }
+    }
+    return fflush(out) == 0;
+}
@@ -0,0 +1,40 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "sim.h"
+
+class SymbolTable;
+
+// Most bytes formatInstruction writes, including the terminating NUL.
+#define DISASM_TEXT_MAX 48
+// Symbol names in listings are cut to this many characters.
+#define DISASM_NAME_MAX 64
+// Most bytes one listed instruction takes, with its block separator and label.
+#define DISASM_LINE_MAX 256
+// Fewest instructions worth a thread of their own in disassembleImage.
+#define DISASM_MIN_PER_THREAD 4096
+
+// The mnemonic of a decoded instruction, such as "addi"; "HALT", "NOP" or
+// "ILLEGAL" for the instructions that have none.
+const char *instructionMnemonic(const Instruction &inst);
+
+// Writes the assembly text of a decoded instruction to out, which must have room
+// for DISASM_TEXT_MAX bytes, and returns its length. Branch and jump targets are
+// absolute addresses. Works from the fields simDecode fills in, through name
+// tables, and never allocates, so it is cheap enough to call per instruction.
+size_t formatInstruction(const Instruction &inst, char *out);
+
+// Lists a program image from address 0 to out: address, raw bits and text of
+// every instruction, with branch and jump targets named, and a blank line and a
+// label where a basic block starts. Compressed instructions show as the 32-bit
+// instruction they stand for. Images long enough are decoded and formatted on
+// up to threads threads, each taking a range of addresses into a buffer of its
+// own. Symbols, if not NULL, name the targets and blocks.
+bool disassembleImage(const std::vector<uint8_t> &image, FILE *out, unsigned threads,
+                      const SymbolTable *symbols);
+
+#endif
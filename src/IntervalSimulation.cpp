@@ -0,0 +1,170 @@
+#include "IntervalSimulation.h"
+#include "Syscalls.h"
+
+#include <string.h>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+IntervalSimulation::IntervalSimulation(uint64_t interval)
+    : interval(interval < 1 ? 1 : interval), finalStatus(SIM_RUNNING),
+      emulatedSyscalls(false) {}
+
+void IntervalSimulation::takeCheckpoint(Simulator &sim, PagedMemoryStore *mem) {
+    checkpoints.push_back(Checkpoint());
+    Checkpoint &cp = checkpoints.back();
+    cp.regs.reg = sim.getRegisters();
+    cp.pc = sim.getPC();
+    cp.instructionCount = sim.getInstructionCount();
+    cp.memoryHash = hashImage(mem->data(), MEMORY_SIZE);
+    cp.programBreak = sim.getSyscalls() != NULL ? sim.getSyscalls()->getBreak() : 0;
+    for (uint64_t page = 0; page < MEM_NUM_PAGES; page++) {
+        if (mem->isChangedSinceDump(page)) {
+            cp.pages.push_back(page);
+            cp.pageData.insert(cp.pageData.end(), mem->data() + (page << MEM_PAGE_SHIFT),
+                               mem->data() + ((page + 1) << MEM_PAGE_SHIFT));
+        }
+    }
+    mem->clearChangedSinceDump();
+    if ((checkpoints.size() - 1) % INTERVAL_KEYFRAME == 0) {
+        keyframes.push_back(vector<uint8_t>(mem->data(), mem->data() + MEMORY_SIZE));
+    }
+}
+
+SimStatus IntervalSimulation::record(Simulator &sim) {
+    PagedMemoryStore *mem = dynamic_cast<PagedMemoryStore *>(sim.getMemory());
+    checkpoints.clear();
+    keyframes.clear();
+    emulatedSyscalls = sim.getSyscalls() != NULL;
+
+    SimStatus status = SIM_RUNNING;
+    while (status == SIM_RUNNING) {
+        takeCheckpoint(sim, mem);
+        status = sim.run(interval);
+    }
+
+    last.regs.reg = sim.getRegisters();
+    last.pc = sim.getPC();
+    last.instructionCount = sim.getInstructionCount();
+    last.memoryHash = hashImage(mem->data(), MEMORY_SIZE);
+    finalStatus = status;
+    return status;
+}
+
+void IntervalSimulation::memoryAt(size_t checkpoint, vector<uint8_t> &memory) const {
+    size_t keyframe = checkpoint / INTERVAL_KEYFRAME;
+    memory = keyframes[keyframe];
+    for (size_t i = keyframe * INTERVAL_KEYFRAME + 1; i <= checkpoint; i++) {
+        const Checkpoint &cp = checkpoints[i];
+        for (size_t p = 0; p < cp.pages.size(); p++) {
+            memcpy(&memory[(uint64_t)cp.pages[p] << MEM_PAGE_SHIFT], &cp.pageData[p << MEM_PAGE_SHIFT], MEM_PAGE_SIZE);
+        }
+    }
+}
+
+bool IntervalSimulation::replayInterval(size_t index, Simulator &sim, vector<uint8_t> &memory,
+                                        const vector<string> &analyses,
+                                        vector<unique_ptr<AnalysisPlugin> > &results, string &error) const {
+    const Checkpoint &start = checkpoints[index];
+    bool isLast = index + 1 == checkpoints.size();
+    const Checkpoint &end = isLast ? last : checkpoints[index + 1];
+
+    // only the nonzero prefix needs predecoding
+    memoryAt(index, memory);
+    size_t length = memory.size();
+    while (length > 0 && memory[length - 1] == 0) {
+        length--;
+    }
+    memory.resize(length);
+    sim.load(memory);
+    for (unsigned r = 1; r < REG_SIZE; r++) {
+        sim.setReg(r, start.regs.registers[r]);
+    }
+    sim.setPC(start.pc);
+    if (sim.getSyscalls() != NULL) {
+        sim.getSyscalls()->setBreak(start.programBreak);
+    }
+
+    AnalysisPipeline pipeline(false);
+    for (size_t a = 0; a < analyses.size(); a++) {
+        pipeline.add(analyses[a], createAnalysis(analyses[a]));
+    }
+    sim.setAnalysis(&pipeline);
+    // the last interval also steps onto the halt or illegal instruction
+    uint64_t count = end.instructionCount - start.instructionCount;
+    SimStatus status = sim.run(isLast ? count + 1 : count);
+    sim.setAnalysis(NULL);
+    for (size_t a = 0; a < analyses.size(); a++) {
+        results.push_back(pipeline.takePlugin(a));
+    }
+
+    char text[160];
+    PagedMemoryStore *mem = dynamic_cast<PagedMemoryStore *>(sim.getMemory());
+    if (status != (isLast ? finalStatus : SIM_RUNNING) || sim.getInstructionCount() != count ||
+        sim.getPC() != end.pc) {
+        snprintf(text, sizeof(text), "interval %zu ended after %lu instructions at 0x%lx, recorded %lu at 0x%lx",
+                 index, sim.getInstructionCount(), sim.getPC(), count, end.pc);
+        error = text;
+        return false;
+    }
+    for (unsigned r = 1; r < REG_SIZE; r++) {
+        if (sim.getReg(r) != end.regs.registers[r]) {
+            snprintf(text, sizeof(text), "interval %zu ended with x%u = 0x%lx, recorded 0x%lx",
+                     index, r, sim.getReg(r), end.regs.registers[r]);
+            error = text;
+            return false;
+        }
+    }
+    if (hashImage(mem->data(), MEMORY_SIZE) != end.memoryHash) {
+        snprintf(text, sizeof(text), "interval %zu ended with different memory contents", index);
+        error = text;
+        return false;
+    }
+    return true;
+}
+
+bool IntervalSimulation::replay(unsigned threads, const vector<string> &analyses,
+                                vector<unique_ptr<AnalysisPlugin> > &merged, string &error) {
+    size_t count = checkpoints.size();
+    vector<vector<unique_ptr<AnalysisPlugin> > > results(count);
+    vector<string> errors(count);
+    atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        PagedMemoryStore mem;
+        Simulator sim(&mem);
+        HostOutput discard(-1);
+        SyscallEmulator syscalls(discard, discard, -1);
+        if (emulatedSyscalls) {
+            sim.setSyscalls(&syscalls);
+        }
+        vector<uint8_t> memory;
+        for (size_t i = next++; i < count; i = next++) {
+            replayInterval(i, sim, memory, analyses, results[i], errors[i]);
+        }
+    };
+    vector<thread> workers;
+    for (unsigned t = 1; t < threads; t++) {
+        workers.push_back(thread(worker));
+    }
+    worker();
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!errors[i].empty()) {
+            error = errors[i];
+            return false;
+        }
+    }
+    merged.clear();
+    for (size_t a = 0; a < analyses.size(); a++) {
+        merged.push_back(move(results[0][a]));
+        for (size_t i = 1; i < count; i++) {
+            merged[a]->merge(*results[i][a]);
+        }
+    }
+    return true;
+}
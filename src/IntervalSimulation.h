@@ -0,0 +1,71 @@
+#ifndef INTERVAL_SIMULATION_H
+#define INTERVAL_SIMULATION_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Simulator.h"
+#include "AnalysisPipeline.h"
+
+// checkpoints between full copies of memory, which bound the deltas a replay applies
+#define INTERVAL_KEYFRAME 64
+
+// Runs the analyses of one long program on every core.
+//
+// record() is a plain functional run that stops every interval instructions to
+// take a checkpoint: registers, PC and the memory pages changed since the previous
+// checkpoint. replay() then simulates every interval again, in parallel, each on a
+// worker starting from its checkpoint with fresh instances of the analyses, and
+// merges their results in program order. Every interval must end in exactly the
+// state the functional run recorded for the start of the next.
+//
+// System calls are performed again on replay, with their output discarded and
+// fd 0 at end of file; a program that reads input diverges.
+//
+// Analyses that carry state from one instruction to the next (a branch predictor,
+// a cache) start every interval cold, so their merged results are approximate;
+// counts are exact.
+class IntervalSimulation
+{
+    public:
+        explicit IntervalSimulation(uint64_t interval);
+
+        // Runs sim, freshly loaded on a PagedMemoryStore, to a halt or an illegal
+        // instruction. sim holds the final state afterwards.
+        SimStatus record(Simulator &sim);
+
+        size_t getIntervalCount() const { return checkpoints.size(); }
+
+        // Replays every interval on threads workers with the named analyses and
+        // merges their results into merged, one plugin per name. Returns false with
+        // error describing the first interval that diverged from the recording.
+        bool replay(unsigned threads, const std::vector<std::string> &analyses,
+                    std::vector<std::unique_ptr<AnalysisPlugin> > &merged, std::string &error);
+
+    private:
+        struct Checkpoint {
+            REGS regs;
+            uint64_t pc;
+            uint64_t instructionCount;
+            uint64_t memoryHash;
+            uint64_t programBreak;       // of the SyscallEmulator, if any
+            std::vector<uint32_t> pages; // changed since the previous checkpoint
+            std::vector<uint8_t> pageData;
+        };
+
+        void takeCheckpoint(Simulator &sim, PagedMemoryStore *mem);
+        void memoryAt(size_t checkpoint, std::vector<uint8_t> &memory) const;
+        bool replayInterval(size_t index, Simulator &sim, std::vector<uint8_t> &memory,
+                            const std::vector<std::string> &analyses,
+                            std::vector<std::unique_ptr<AnalysisPlugin> > &results, std::string &error) const;
+
+        uint64_t interval;
+        std::vector<Checkpoint> checkpoints;
+        std::vector<std::vector<uint8_t> > keyframes; // memory at every INTERVAL_KEYFRAME'th checkpoint
+        Checkpoint last;                              // the state after the last instruction
+        SimStatus finalStatus;
+        bool emulatedSyscalls;
+};
+
+#endif
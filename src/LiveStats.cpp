@@ -0,0 +1,107 @@
+#include "LiveStats.h"
+#include "Simulator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+LiveStats::LiveStats() : page(NULL), compressed(0), lastInstructions(0), publishes(0) {
+    memset(mix, 0, sizeof(mix));
+    memset(classOf, MIX_ALU, sizeof(classOf));
+    for (int muldiv = 0; muldiv < 2; muldiv++) {
+        classOf[muldiv][OP_LOAD] = MIX_LOAD;
+        classOf[muldiv][OP_STORE] = MIX_STORE;
+        classOf[muldiv][OP_SBTYPE] = MIX_BRANCH;
+        classOf[muldiv][OP_JAL] = MIX_JUMP;
+        classOf[muldiv][OP_JALR] = MIX_JUMP;
+        classOf[muldiv][OP_SYSTEM] = MIX_SYSTEM;
+    }
+    classOf[1][OP_RTYPE] = MIX_MULDIV;
+    classOf[1][OP_RTYPEW] = MIX_MULDIV;
+}
+
+LiveStats::~LiveStats() {
+    if (page != NULL) {
+        munmap(page, sizeof(LiveStatsPage));
+    }
+}
+
+bool LiveStats::open(const char *path, const char *programFile) {
+    int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    if (ftruncate(fd, sizeof(LiveStatsPage)) != 0) {
+        perror(path);
+        close(fd);
+        return false;
+    }
+    void *mapped = mmap(NULL, sizeof(LiveStatsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+
+    // the file starts out zeroed, so every counter is already a valid 0
+    page = static_cast<LiveStatsPage *>(mapped);
+    page->version = LIVE_STATS_VERSION;
+    page->size = sizeof(LiveStatsPage);
+    page->pid = getpid();
+    strncpy(page->program, programFile, sizeof(page->program) - 1);
+    start = chrono::steady_clock::now();
+    lastPublish = start;
+    // the magic last: a reader that sees it sees the rest of the header
+    atomic_thread_fence(memory_order_release);
+    memcpy(page->magic, LIVE_STATS_MAGIC, sizeof(page->magic));
+    return true;
+}
+
+void LiveStats::publish(Simulator &sim) {
+    if (page == NULL) {
+        return;
+    }
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    uint64_t instructions = sim.getInstructionCount();
+    uint64_t sinceLast = chrono::duration_cast<chrono::nanoseconds>(now - lastPublish).count();
+    if (sinceLast > 0) {
+        // a reload starts the count over
+        uint64_t retired = instructions >= lastInstructions ? instructions - lastInstructions : instructions;
+        page->recentIps.store((uint64_t)(retired * 1e9 / sinceLast), memory_order_relaxed);
+    }
+    lastPublish = now;
+    lastInstructions = instructions;
+
+    page->instructions.store(instructions, memory_order_relaxed);
+    page->pc.store(sim.getPC(), memory_order_relaxed);
+    page->status.store(sim.getStatus(), memory_order_relaxed);
+    page->elapsedNanos.store(chrono::duration_cast<chrono::nanoseconds>(now - start).count(),
+                             memory_order_relaxed);
+    for (int c = 0; c < MIX_CLASSES; c++) {
+        page->mix[c].store(mix[c], memory_order_relaxed);
+    }
+    page->compressed.store(compressed, memory_order_relaxed);
+    page->imageBytes.store(sim.getImageLength(), memory_order_relaxed);
+    PagedMemoryStore *paged = dynamic_cast<PagedMemoryStore *>(sim.getMemory());
+    if (paged != NULL) {
+        page->writtenBytes.store(paged->dirtyPageCount() * MEM_PAGE_SIZE, memory_order_relaxed);
+    }
+    page->publishes.store(++publishes, memory_order_relaxed);
+}
+
+void LiveStats::finish(Simulator &sim) {
+    if (page == NULL) {
+        return;
+    }
+    // the last run already published, unless the simulator was stepped since
+    if (sim.getInstructionCount() != lastInstructions) {
+        publish(sim);
+    }
+    page->status.store(LIVE_STATS_FINISHED | sim.getStatus(), memory_order_relaxed);
+    msync(page, sizeof(LiveStatsPage), MS_ASYNC);
+}
@@ -0,0 +1,92 @@
+#ifndef LIVE_STATS_H
+#define LIVE_STATS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+#include "sim.h"
+
+class Simulator;
+
+// Bump whenever LiveStatsPage changes, so simtop refuses pages it would misread.
+#define LIVE_STATS_VERSION 1
+#define LIVE_STATS_MAGIC "RVSIMST"
+
+// Classes of the instruction mix, by opcode.
+enum StatsMixClass {
+    MIX_ALU = 0, // register and immediate arithmetic, lui, auipc, nops
+    MIX_MULDIV,  // RV64M
+    MIX_LOAD,
+    MIX_STORE,
+    MIX_BRANCH,
+    MIX_JUMP,    // jal, jalr
+    MIX_SYSTEM,  // ecall
+    MIX_CLASSES
+};
+
+// The layout of a stats file. The simulator maps it shared and writes each
+// counter with a relaxed atomic store; readers map it read-only and load them
+// the same way. Counters are consistent one at a time, not with each other,
+// which is all a monitor needs.
+struct LiveStatsPage {
+    char magic[8];            // LIVE_STATS_MAGIC
+    uint32_t version;         // LIVE_STATS_VERSION
+    uint32_t size;            // sizeof(LiveStatsPage)
+    uint64_t pid;             // of the simulator, to tell a finished run from a killed one
+    char program[240];        // the program file being run
+
+    std::atomic<uint64_t> publishes;    // counts up on every update
+    std::atomic<uint64_t> status;       // SimStatus; LIVE_STATS_FINISHED once the run is over
+    std::atomic<uint64_t> instructions; // retired
+    std::atomic<uint64_t> pc;
+    std::atomic<uint64_t> elapsedNanos; // since the stats were opened
+    std::atomic<uint64_t> recentIps;    // instructions per second since the previous update
+    std::atomic<uint64_t> mix[MIX_CLASSES];
+    std::atomic<uint64_t> compressed;   // retired instructions that were 2 bytes long
+    std::atomic<uint64_t> imageBytes;   // program image
+    std::atomic<uint64_t> writtenBytes; // memory pages stored to
+};
+
+#define LIVE_STATS_FINISHED 0x100
+
+// The simulator's side of a stats file. Simulator::step counts the instruction
+// mix in plain memory and Simulator::run publishes everything at its end, so a
+// run in slices (as sim does, RUN_SLICE instructions at a time) updates the file
+// a few times a second at the cost of one increment per instruction.
+class LiveStats
+{
+    public:
+        LiveStats();
+        ~LiveStats();
+
+        // Creates (or truncates) path and maps it. Returns false, having
+        // printed why, if that fails.
+        bool open(const char *path, const char *programFile);
+
+        void record(const Instruction &inst) {
+            mix[classOf[inst.funct7 == FUNCT7_MULDIV][inst.opcode & 0x7f]]++;
+            compressed += inst.length == 2;
+        }
+
+        // Writes the current counters of sim to the page.
+        void publish(Simulator &sim);
+
+        // Publishes a last time and marks the run as over.
+        void finish(Simulator &sim);
+
+    private:
+        LiveStats(const LiveStats &) = delete;
+        LiveStats &operator=(const LiveStats &) = delete;
+
+        LiveStatsPage *page;
+        uint64_t mix[MIX_CLASSES];
+        uint64_t compressed;
+        uint8_t classOf[2][128]; // StatsMixClass by funct7 == FUNCT7_MULDIV and opcode
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point lastPublish;
+        uint64_t lastInstructions;
+        uint64_t publishes;
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include "PagedMemoryStore.h"
+#include "StateDump.h"
+#include "Devices.h"
+
+#include <errno.h>
+#include <algorithm>
+
+using namespace std;
+
+PagedMemoryStore::PagedMemoryStore()
+    : mem(MEMORY_SIZE, 0), pristine(MEMORY_SIZE, 0), imageLength(0), reportErrors(true),
+      devices(NULL) {
+    memset(dirty, 0, sizeof(dirty));
+    memset(changed, 0, sizeof(changed));
+    unprotectAll();
+}
+
+int PagedMemoryStore::accessError(uint64_t address, MemEntrySize size) {
+    if (reportErrors) {
+        fprintf(stderr, "[ERROR] Access violation at address 0x%lx (%d bytes)\n", address, (int)size);
+    }
+    return -EINVAL;
+}
+
+int PagedMemoryStore::deviceRead(uint64_t address, uint64_t &value, MemEntrySize size) {
+    if (devices != NULL && devices->read(address, value, size)) {
+        return 0;
+    }
+    return accessError(address, size);
+}
+
+int PagedMemoryStore::deviceWrite(uint64_t address, uint64_t value, MemEntrySize size) {
+    if (devices != NULL && devices->write(address, value, size)) {
+        return 0;
+    }
+    return accessError(address, size);
+}
+
+int PagedMemoryStore::printMemory(uint64_t startAddress, uint64_t endAddress) {
+    string text;
+    formatMemoryRange(this, startAddress, endAddress, text);
+    fwrite(text.data(), 1, text.size(), stdout);
+    return 0;
+}
+
+void PagedMemoryStore::loadImage(const vector<uint8_t> &image) {
+    uint64_t oldLength = imageLength;
+    imageLength = image.size();
+    if (imageLength > MEMORY_SIZE) {
+        fprintf(stderr, "[ERROR] Program image of %lu bytes truncated to memory size\n", imageLength);
+        imageLength = MEMORY_SIZE;
+    }
+    memcpy(pristine.data(), image.data(), imageLength);
+    if (oldLength > imageLength) {
+        memset(pristine.data() + imageLength, 0, oldLength - imageLength);
+    }
+
+    // past both images memory is zero except on dirty pages, which reset restores
+    uint64_t span = max(oldLength, imageLength);
+    memcpy(mem.data(), pristine.data(), span);
+    for (uint64_t page = 0; page < (span + MEM_PAGE_SIZE - 1) >> MEM_PAGE_SHIFT; page++) {
+        changed[page >> 6] |= 1ULL << (page & 63);
+    }
+    reset();
+}
+
+void PagedMemoryStore::reset() {
+    for (uint64_t word = 0; word < sizeof(dirty) / sizeof(dirty[0]); word++) {
+        while (dirty[word] != 0) {
+            uint64_t page = word * 64 + __builtin_ctzll(dirty[word]);
+            memcpy(&mem[page << MEM_PAGE_SHIFT], &pristine[page << MEM_PAGE_SHIFT], MEM_PAGE_SIZE);
+            changed[word] |= dirty[word] & -dirty[word];
+            dirty[word] &= dirty[word] - 1;
+        }
+    }
+}
+
+uint64_t PagedMemoryStore::dirtyPageCount() const {
+    uint64_t count = 0;
+    for (uint64_t word = 0; word < sizeof(dirty) / sizeof(dirty[0]); word++) {
+        count += __builtin_popcountll(dirty[word]);
+    }
+    return count;
+}
+
+MemoryImagePool::~MemoryImagePool() {
+    for (size_t i = 0; i < idle.size(); i++) {
+        delete idle[i];
+    }
+}
+
+MemoryImagePool &MemoryImagePool::local() {
+    static thread_local MemoryImagePool pool;
+    return pool;
+}
+
+PagedMemoryStore *MemoryImagePool::acquire(const vector<uint8_t> &image) {
+    // prefer the most recently released store of the same program
+    for (size_t i = idle.size(); i-- > 0; ) {
+        if (idle[i]->holdsImage(image)) {
+            PagedMemoryStore *store = idle[i];
+            idle.erase(idle.begin() + i);
+            store->reset();
+            return store;
+        }
+    }
+
+    PagedMemoryStore *store;
+    if (!idle.empty()) {
+        store = idle.front();
+        idle.erase(idle.begin());
+    }
+    else {
+        store = new PagedMemoryStore();
+    }
+    store->loadImage(image);
+    return store;
+}
+
+void MemoryImagePool::release(PagedMemoryStore *store) {
+    // watchpoints and devices belong to the simulator that set them
+    store->unprotectAll();
+    store->setDevices(NULL);
+    idle.push_back(store);
+    if (idle.size() > MEMORY_POOL_CAPACITY) {
+        delete idle.front();
+        idle.erase(idle.begin());
+    }
+}
@@ -0,0 +1,149 @@
+#ifndef PAGED_MEMORY_STORE_H
+#define PAGED_MEMORY_STORE_H
+
+#include <string.h>
+#include <vector>
+
+#include "sim.h"
+
+class DeviceBus;
+
+// Granularity of dirty tracking.
+#define MEM_PAGE_SHIFT 10
+#define MEM_PAGE_SIZE  (1 << MEM_PAGE_SHIFT)
+#define MEM_NUM_PAGES  (MEMORY_SIZE / MEM_PAGE_SIZE)
+
+// A flat MEMORY_SIZE memory that remembers the program image it was loaded with
+// and which pages have been written since. reset() copies only those pages back
+// from the pristine image, so rerunning a short program costs a few hundred bytes
+// of copying rather than a fresh store and a reload.
+class PagedMemoryStore : public MemoryStore
+{
+    public:
+        PagedMemoryStore();
+
+        int getMemValue(uint64_t address, uint64_t &value, MemEntrySize size) override {
+            if (address + size > MEMORY_SIZE || address + size < address) {
+                return deviceRead(address, value, size);
+            }
+            // host is little-endian, like the guest
+            value = 0;
+            memcpy(&value, &mem[address], size);
+            return 0;
+        }
+
+        int setMemValue(uint64_t address, uint64_t value, MemEntrySize size) override {
+            if (address + size > MEMORY_SIZE || address + size < address) {
+                return deviceWrite(address, value, size);
+            }
+            memcpy(&mem[address], &value, size);
+            uint64_t first = address >> MEM_PAGE_SHIFT;
+            uint64_t last = (address + size - 1) >> MEM_PAGE_SHIFT;
+            markDirty(first);
+            markDirty(last);
+            if (isProtected(first) || isProtected(last)) {
+                protectedStore = true;
+                protectedAddress = address;
+                protectedSize = size;
+            }
+            return 0;
+        }
+
+        int printMemory(uint64_t startAddress, uint64_t endAddress) override;
+
+        // Makes image (zero-filled to MEMORY_SIZE) the pristine contents and loads it.
+        void loadImage(const std::vector<uint8_t> &image);
+
+        // Whether image is the program this store was loaded with.
+        bool holdsImage(const std::vector<uint8_t> &image) const {
+            return image.size() == imageLength && memcmp(image.data(), pristine.data(), imageLength) == 0;
+        }
+
+        // Restores every page written since loadImage or the last reset.
+        void reset();
+
+        bool isDirty(uint64_t page) const { return (dirty[page >> 6] >> (page & 63)) & 1; }
+        uint64_t dirtyPageCount() const;
+
+        // A second dirty set for delta dumps: pages whose contents changed since
+        // clearChangedSinceDump, by a store, a reset or a load.
+        bool isChangedSinceDump(uint64_t page) const { return (changed[page >> 6] >> (page & 63)) & 1; }
+        void clearChangedSinceDump() { memset(changed, 0, sizeof(changed)); }
+
+        // The raw MEMORY_SIZE bytes, for dumps and comparisons.
+        const uint8_t *data() const { return mem.data(); }
+
+        // Write protection for watchpoints. A store touching a protected page still
+        // goes through, but is remembered until takeProtectedStore, so that stores
+        // to other pages cost no more than a bit test.
+        void protectPage(uint64_t page) { protectedPages[page >> 6] |= 1ULL << (page & 63); }
+        void unprotectAll() {
+            memset(protectedPages, 0, sizeof(protectedPages));
+            protectedStore = false;
+        }
+        bool isProtected(uint64_t page) const { return (protectedPages[page >> 6] >> (page & 63)) & 1; }
+
+        // Returns the last store to a protected page since the previous call, if any.
+        bool takeProtectedStore(uint64_t &address, uint64_t &size) {
+            if (!protectedStore) {
+                return false;
+            }
+            protectedStore = false;
+            address = protectedAddress;
+            size = protectedSize;
+            return true;
+        }
+
+        // Accesses outside RAM go to devices (the caller keeps ownership), if not
+        // NULL, before they count as access violations.
+        void setDevices(DeviceBus *bus) { devices = bus; }
+
+        // Whether out of range accesses are reported on stderr (the default).
+        void setReportErrors(bool report) { reportErrors = report; }
+
+    private:
+        void markDirty(uint64_t page) {
+            dirty[page >> 6] |= 1ULL << (page & 63);
+            changed[page >> 6] |= 1ULL << (page & 63);
+        }
+        int accessError(uint64_t address, MemEntrySize size);
+        int deviceRead(uint64_t address, uint64_t &value, MemEntrySize size);
+        int deviceWrite(uint64_t address, uint64_t value, MemEntrySize size);
+
+        std::vector<uint8_t> mem;
+        std::vector<uint8_t> pristine;
+        uint64_t imageLength;
+        bool reportErrors;
+        DeviceBus *devices;
+        uint64_t dirty[(MEM_NUM_PAGES + 63) / 64];
+        uint64_t changed[(MEM_NUM_PAGES + 63) / 64];
+        uint64_t protectedPages[(MEM_NUM_PAGES + 63) / 64];
+        bool protectedStore;
+        uint64_t protectedAddress;
+        uint64_t protectedSize;
+};
+
+// Idle PagedMemoryStores kept per thread, so that back-to-back runs of the same
+// program pick up an image that only needs a reset instead of a full load.
+class MemoryImagePool
+{
+    public:
+        ~MemoryImagePool();
+
+        // This thread's pool.
+        static MemoryImagePool &local();
+
+        // Returns a store holding image in its pristine state. The caller owns
+        // it until it is handed back with release.
+        PagedMemoryStore *acquire(const std::vector<uint8_t> &image);
+        void release(PagedMemoryStore *store);
+
+    private:
+        // idle stores, most recently released last
+        std::vector<PagedMemoryStore *> idle;
+};
+
+// Idle stores kept per thread beyond which the least recently released are freed.
+#define MEMORY_POOL_CAPACITY 8
+
+#endif
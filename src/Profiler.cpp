@@ -0,0 +1,143 @@
+#include "Profiler.h"
+#include "Disassembler.h"
+
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+Profiler::Profiler(uint64_t period)
+    : period(period < 1 ? 1 : period), random(0x9e3779b97f4a7c15ULL), samples(0),
+      pcWeights(MEMORY_SIZE / 2, 0), current(0), depth(0), untracked(0) {
+    nodes.push_back({0, 0, 0});
+    interval = countdown = nextInterval();
+}
+
+uint64_t Profiler::nextInterval() {
+    if (period == 1) {
+        return 1;
+    }
+    // xorshift64; uniform in [period/2, period*3/2) keeps the mean at period
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+    return period / 2 + random % period;
+}
+
+void Profiler::trackCall(const Instruction &inst) {
+    if (inst.rd == 1) {
+        if (depth >= PROFILE_MAX_CALL_DEPTH) {
+            untracked++;
+            return;
+        }
+        pair<uint32_t, uint64_t> key(current, inst.nextPC);
+        map<pair<uint32_t, uint64_t>, uint32_t>::iterator it = children.find(key);
+        if (it == children.end()) {
+            it = children.insert(make_pair(key, (uint32_t)nodes.size())).first;
+            nodes.push_back({current, inst.nextPC, 0});
+        }
+        current = it->second;
+        depth++;
+    }
+    else if (inst.opcode == OP_JALR && inst.rd == 0 && inst.rs1 == 1 && inst.imm == 0) {
+        if (untracked > 0) {
+            untracked--;
+        }
+        else if (depth > 0) {
+            current = nodes[current].parent;
+            depth--;
+        }
+    }
+}
+
+void Profiler::sample(uint64_t pc) {
+    if ((pc >> 1) < pcWeights.size()) {
+        pcWeights[pc >> 1] += interval;
+    }
+    nodes[current].weight += interval;
+    samples++;
+    interval = countdown = nextInterval();
+}
+
+bool Profiler::writeFolded(const char *path) const {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+    vector<string> frames;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].weight == 0) {
+            continue;
+        }
+        frames.clear();
+        for (uint32_t n = i; ; n = nodes[n].parent) {
+            frames.push_back(symbols.describe(nodes[n].function));
+            if (n == 0) {
+                break;
+            }
+        }
+        string line;
+        for (size_t k = frames.size(); k-- > 0; ) {
+            line += frames[k];
+            line += k > 0 ? ";" : "";
+        }
+        fprintf(f, "%s %lu\n", line.c_str(), nodes[i].weight);
+    }
+    return fclose(f) == 0;
+}
+
+void Profiler::printTop(FILE *out, unsigned n, MemoryStore *mem) const {
+    uint64_t total = 0;
+    vector<uint64_t> hot;
+    for (size_t i = 0; i < pcWeights.size(); i++) {
+        if (pcWeights[i] != 0) {
+            total += pcWeights[i];
+            hot.push_back(i);
+        }
+    }
+    if (total == 0) {
+        fprintf(out, "Profile: no instructions executed\n");
+        return;
+    }
+    sort(hot.begin(), hot.end(), [this](uint64_t a, uint64_t b) { return pcWeights[a] > pcWeights[b]; });
+    if (hot.size() > n) {
+        hot.resize(n);
+    }
+
+    if (period == 1) {
+        fprintf(out, "Profile: %lu instructions\n", total);
+    }
+    else {
+        fprintf(out, "Profile: ~%lu instructions from %lu samples\n", total, samples);
+    }
+
+    if (!symbols.empty()) {
+        map<string, uint64_t> functions;
+        for (size_t i = 0; i < pcWeights.size(); i++) {
+            if (pcWeights[i] != 0) {
+                const SymbolTable::Symbol *symbol = symbols.find(i * 2);
+                functions[symbol != NULL ? symbol->name : "?"] += pcWeights[i];
+            }
+        }
+        vector<pair<uint64_t, string> > byWeight;
+        for (map<string, uint64_t>::const_iterator it = functions.begin(); it != functions.end(); ++it) {
+            byWeight.push_back(make_pair(it->second, it->first));
+        }
+        sort(byWeight.rbegin(), byWeight.rend());
+        fprintf(out, "\n%14s %7s  %s\n", "instructions", "%", "function");
+        for (size_t i = 0; i < byWeight.size() && i < n; i++) {
+            fprintf(out, "%14lu %6.2f%%  %s\n", byWeight[i].first, 100.0 * byWeight[i].first / total,
+                    byWeight[i].second.c_str());
+        }
+    }
+
+    fprintf(out, "\n%14s %7s  %-10s  %-24s %s\n", "instructions", "%", "pc", "location", "instruction");
+    for (size_t i = 0; i < hot.size(); i++) {
+        uint64_t pc = hot[i] * 2;
+        char text[DISASM_TEXT_MAX];
+        formatInstruction(simDecode(simFetch(pc, mem)), text); // compressed ones as their 32-bit equivalent
+        fprintf(out, "%14lu %6.2f%%  0x%08lx  %-24s %s\n", pcWeights[hot[i]], 100.0 * pcWeights[hot[i]] / total,
+                pc, symbols.describe(pc).c_str(), text);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+#include <map>
+
+#include "sim.h"
+#include "SymbolTable.h"
+
+// Deeper call chains are folded into their deepest tracked frame.
+#define PROFILE_MAX_CALL_DEPTH 256
+
+// Counts where a program spends its instructions, per PC and per call stack.
+//
+// The call stack is rebuilt from the instruction stream: a JAL or JALR writing
+// ra is a call to its target, and jalr x0, 0(ra) returns. Stacks are kept as
+// nodes of a calling context tree, so a sample costs one increment.
+//
+// With a period of 1 every instruction is counted. A larger period samples
+// roughly one instruction in that many (with jitter, so loops of the same length
+// do not alias) and weighs each sample by the instructions since the last one.
+class Profiler
+{
+    public:
+        explicit Profiler(uint64_t period = 1);
+
+        // Names functions in the reports; addresses are printed otherwise.
+        SymbolTable &getSymbols() { return symbols; }
+
+        // Called by Simulator::step for every executed instruction.
+        void record(const Instruction &inst) {
+            if (inst.opcode == OP_JAL || inst.opcode == OP_JALR) {
+                trackCall(inst);
+            }
+            if (--countdown == 0) {
+                sample(inst.PC);
+            }
+        }
+
+        uint64_t getSampleCount() const { return samples; }
+
+        // Writes one "frame;frame;frame count" line per call stack, the input
+        // format of flamegraph.pl and speedscope.
+        bool writeFolded(const char *path) const;
+
+        // Lists the n hottest instructions with their function and disassembly.
+        void printTop(FILE *out, unsigned n, MemoryStore *mem) const;
+
+    private:
+        struct Node {
+            uint32_t parent;
+            uint64_t function; // entry address
+            uint64_t weight;
+        };
+
+        void trackCall(const Instruction &inst);
+        void sample(uint64_t pc);
+        uint64_t nextInterval();
+
+        uint64_t period;
+        uint64_t interval;  // instructions between the previous sample and the next
+        uint64_t countdown;
+        uint64_t random;
+        uint64_t samples;
+
+        std::vector<uint64_t> pcWeights; // per 2-byte parcel
+        std::vector<Node> nodes;         // nodes[0] is the program entry
+        std::map<std::pair<uint32_t, uint64_t>, uint32_t> children;
+        uint32_t current;
+        uint32_t depth;
+        uint32_t untracked; // calls made beyond PROFILE_MAX_CALL_DEPTH
+
+        SymbolTable symbols;
+};
+
+#endif
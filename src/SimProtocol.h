@@ -0,0 +1,89 @@
+#ifndef SIM_PROTOCOL_H
+#define SIM_PROTOCOL_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+// Wire format between `sim --serve` and simclient. Both ends run on the same host,
+// so fields travel in host byte order. A connection carries any number of jobs, each
+// a JobRequest (plus optional registers and payload) answered by a JobResponse
+// followed by the register and memory dump text, then what the program wrote to
+// its stdout and stderr.
+
+#define SIM_PROTOCOL_VERSION 2
+#define JOB_REQUEST_MAGIC    0x4a535652 // "RVSJ"
+#define JOB_RESPONSE_MAGIC   0x52535652 // "RVSR"
+
+// Largest payload a server accepts.
+#define JOB_MAX_PAYLOAD (1 << 20)
+// Program output a server returns per stream; the rest is dropped.
+#define JOB_MAX_OUTPUT (1 << 20)
+
+// JobRequest flags
+#define JOB_PROGRAM_PATH 0x1 // payload is a path on the server host, not program bytes
+#define JOB_INIT_REGS    0x2 // REG_SIZE uint64_t register values precede the payload
+
+// JobResponse status values besides SimStatus
+#define JOB_BAD_REQUEST 0x100
+#define JOB_LOAD_FAILED 0x101
+#define JOB_SPINNING    0x102 // stopped in an endless loop, see Simulator::findSpin
+
+struct JobRequest {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint64_t maxInstructions; // 0 runs until halt, an illegal instruction or an endless loop
+    uint32_t payloadLength;
+    uint32_t reserved;
+};
+
+struct JobResponse {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t status;          // SimStatus or a JOB_* error
+    uint64_t instructions;
+    uint64_t pc;
+    uint64_t elapsedNs;       // load and run, not the dumps
+    uint32_t regDumpLength;
+    uint32_t memDumpLength;
+    uint32_t outputLength;    // written to fd 1, at most JOB_MAX_OUTPUT
+    uint32_t errorLength;     // written to fd 2, at most JOB_MAX_OUTPUT
+    uint32_t exited;          // 1 if the program called exit, which halts it
+    int32_t exitCode;         // its status, if it did
+};
+
+// read or write exactly length bytes, false on EOF or error
+static inline bool readFull(int fd, void *buf, size_t length) {
+    uint8_t *p = (uint8_t *)buf;
+    while (length > 0) {
+        ssize_t n = read(fd, p, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+static inline bool writeFull(int fd, const void *buf, size_t length) {
+    const uint8_t *p = (const uint8_t *)buf;
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,217 @@
+#include "SimServer.h"
+#include "SimProtocol.h"
+#include "Simulator.h"
+#include "StateDump.h"
+#include "Syscalls.h"
+
+#include <string.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+// Instructions run between checks for an endless loop.
+static const uint64_t SPIN_CHECK_INTERVAL = 1 << 20;
+
+// Accepted connections waiting for a free worker.
+struct ConnectionQueue {
+    mutex lock;
+    condition_variable ready;
+    deque<int> fds;
+};
+
+// socket path removed on SIGINT/SIGTERM
+static const char *serverSocketPath = NULL;
+
+static void onTerminate(int sig) {
+    if (serverSocketPath != NULL) {
+        unlink(serverSocketPath);
+    }
+    _exit(128 + sig);
+}
+
+// Per-worker state, kept across jobs so they start warm. Jobs read an empty
+// stdin, and what they write is returned with the response.
+struct Worker {
+    Simulator sim;
+    vector<uint8_t> payload;
+    vector<uint8_t> image;
+    string regDump;
+    string memDump;
+    string output;
+    string error;
+    HostOutput guestOut;
+    HostOutput guestErr;
+    SyscallEmulator syscalls;
+
+    Worker() : guestOut(output, JOB_MAX_OUTPUT), guestErr(error, JOB_MAX_OUTPUT),
+               syscalls(guestOut, guestErr, -1) {
+        sim.setSyscalls(&syscalls);
+    }
+};
+
+// Runs one job; false if the connection should be dropped.
+static bool serveJob(int fd, Worker &worker) {
+    JobRequest request;
+    if (!readFull(fd, &request, sizeof(request))) {
+        return false;
+    }
+
+    JobResponse response;
+    memset(&response, 0, sizeof(response));
+    response.magic = JOB_RESPONSE_MAGIC;
+    response.version = SIM_PROTOCOL_VERSION;
+    if (request.magic != JOB_REQUEST_MAGIC || request.version != SIM_PROTOCOL_VERSION ||
+        request.payloadLength > JOB_MAX_PAYLOAD) {
+        // the rest of the stream cannot be trusted
+        response.status = JOB_BAD_REQUEST;
+        writeFull(fd, &response, sizeof(response));
+        return false;
+    }
+
+    uint64_t initRegs[REG_SIZE];
+    if ((request.flags & JOB_INIT_REGS) && !readFull(fd, initRegs, sizeof(initRegs))) {
+        return false;
+    }
+    worker.payload.resize(request.payloadLength);
+    if (!readFull(fd, worker.payload.data(), request.payloadLength)) {
+        return false;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Simulator &sim = worker.sim;
+    bool loaded = true;
+    if (request.flags & JOB_PROGRAM_PATH) {
+        string path(worker.payload.begin(), worker.payload.end());
+        loaded = loadProgramImage(path.c_str(), worker.image);
+    }
+    else {
+        worker.image.swap(worker.payload);
+    }
+
+    worker.regDump.clear();
+    worker.memDump.clear();
+    worker.output.clear();
+    worker.error.clear();
+    if (!loaded) {
+        response.status = JOB_LOAD_FAILED;
+    }
+    else {
+        sim.load(worker.image);
+        if (request.flags & JOB_INIT_REGS) {
+            for (unsigned i = 1; i < REG_SIZE; i++) {
+                sim.setReg(i, initRegs[i]);
+            }
+        }
+        // a job stuck in an endless loop would hold its worker forever
+        uint64_t budget = request.maxInstructions ? request.maxInstructions : UINT64_MAX;
+        SimStatus status = SIM_RUNNING;
+        bool spinning = false;
+        while (status == SIM_RUNNING && !spinning && sim.getInstructionCount() < budget) {
+            status = sim.run(min(SPIN_CHECK_INTERVAL, budget - sim.getInstructionCount()));
+            if (status == SIM_RUNNING && sim.getInstructionCount() < budget) {
+                spinning = sim.findSpin(min((uint64_t)SPIN_WINDOW, budget - sim.getInstructionCount()));
+                status = sim.getStatus();
+            }
+        }
+        worker.guestOut.flush();
+        worker.guestErr.flush();
+        response.status = spinning ? JOB_SPINNING : status;
+        response.exited = worker.syscalls.hasExited();
+        response.exitCode = worker.syscalls.getExitCode();
+        response.instructions = sim.getInstructionCount();
+        response.pc = sim.getPC();
+        response.elapsedNs = chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - start).count();
+
+        formatRegisterState(sim.getRegisters(), worker.regDump);
+        formatMemoryState(sim.getMemory(), worker.memDump);
+    }
+    response.regDumpLength = worker.regDump.size();
+    response.memDumpLength = worker.memDump.size();
+    response.outputLength = worker.output.size();
+    response.errorLength = worker.error.size();
+
+    return writeFull(fd, &response, sizeof(response))
+        && writeFull(fd, worker.regDump.data(), worker.regDump.size())
+        && writeFull(fd, worker.memDump.data(), worker.memDump.size())
+        && writeFull(fd, worker.output.data(), worker.output.size())
+        && writeFull(fd, worker.error.data(), worker.error.size());
+}
+
+static void workerMain(ConnectionQueue *queue) {
+    Worker worker;
+    while (true) {
+        int fd;
+        {
+            unique_lock<mutex> guard(queue->lock);
+            queue->ready.wait(guard, [queue] { return !queue->fds.empty(); });
+            fd = queue->fds.front();
+            queue->fds.pop_front();
+        }
+        while (serveJob(fd, worker)) {
+        }
+        close(fd);
+    }
+}
+
+int runSimServer(const char *socketPath, unsigned workers) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socketPath);
+        return -1;
+    }
+    strcpy(addr.sun_path, socketPath);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(socketPath);
+    if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd, 128) != 0) {
+        perror(socketPath);
+        close(listenFd);
+        return -1;
+    }
+
+    // a client hanging up mid-response must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    serverSocketPath = socketPath;
+    signal(SIGINT, onTerminate);
+    signal(SIGTERM, onTerminate);
+
+    if (workers == 0) {
+        workers = 1;
+    }
+    ConnectionQueue queue;
+    for (unsigned i = 0; i < workers; i++) {
+        thread(workerMain, &queue).detach();
+    }
+    fprintf(stderr, "Serving on %s with %u workers\n", socketPath, workers);
+
+    while (true) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR) {
+                perror("accept");
+            }
+            continue;
+        }
+        {
+            lock_guard<mutex> guard(queue.lock);
+            queue.fds.push_back(fd);
+        }
+        queue.ready.notify_one();
+    }
+}
@@ -0,0 +1,9 @@
+#ifndef SIM_SERVER_H
+#define SIM_SERVER_H
+
+// Serves simulation jobs (see SimProtocol.h) on a Unix domain socket. Each of the
+// workers threads keeps a warm Simulator and serves one connection at a time.
+// Only returns if the socket cannot be set up.
+int runSimServer(const char *socketPath, unsigned workers);
+
+#endif
@@ -0,0 +1,353 @@
+#include "Simulator.h"
+#include "Profiler.h"
+#include "AnalysisPipeline.h"
+#include "UndoLog.h"
+#include "Devices.h"
+#include "Syscalls.h"
+#include "LiveStats.h"
+#include "Coverage.h"
+
+using namespace std;
+
+Simulator::Simulator(MemoryStore *mem)
+    : PC(0), mem(mem), pagedMem(NULL), ownsMem(mem == NULL), status(SIM_RUNNING),
+      instructionCount(0), useTranslations(true), translationCap(TRANSLATION_CACHE_DEFAULT_CAP),
+      profiler(NULL), analysis(NULL), undo(NULL), stats(NULL), coverage(NULL), devices(NULL),
+      syscalls(NULL), imageLength(0), skipBreakpointAt(UINT64_MAX) {
+    if (ownsMem) {
+        // an empty image until the first load
+        pagedMem = MemoryImagePool::local().acquire(vector<uint8_t>());
+        this->mem = pagedMem;
+    }
+    else {
+        pagedMem = dynamic_cast<PagedMemoryStore *>(mem);
+    }
+}
+
+Simulator::~Simulator() {
+    if (ownsMem) {
+        MemoryImagePool::local().release(pagedMem);
+    }
+}
+
+void Simulator::setTranslationCache(bool enabled, const string &cacheDir, uint64_t sizeCap) {
+    useTranslations = enabled;
+    translationDir = cacheDir;
+    translationCap = sizeCap;
+    if (!enabled) {
+        translations.clear();
+    }
+}
+
+bool Simulator::load(const char *programFile) {
+    vector<uint8_t> image;
+    if (!loadProgramImage(programFile, image)) {
+        return false;
+    }
+    load(image);
+    return true;
+}
+
+void Simulator::load(const vector<uint8_t> &image) {
+    if (ownsMem) {
+        // rerunning the same program gets its own image back and only pays for a reset
+        MemoryImagePool &pool = MemoryImagePool::local();
+        pool.release(pagedMem);
+        pagedMem = pool.acquire(image);
+        mem = pagedMem;
+    }
+    else if (pagedMem != NULL) {
+        pagedMem->loadImage(image);
+    }
+    else {
+        initMemory(image, mem);
+    }
+
+    if (useTranslations) {
+        translations.load(image, translationDir, translationCap);
+    }
+    markDebugTargets();
+    if (devices != NULL) {
+        // the store may be a different one from the pool
+        pagedMem->setDevices(devices);
+        devices->reset();
+    }
+    imageLength = image.size();
+    if (syscalls != NULL) {
+        syscalls->reset(imageLength);
+    }
+
+    regData.reg = {};
+    PC = 0;
+    status = SIM_RUNNING;
+    instructionCount = 0;
+    lastInst = Instruction();
+}
+
+void Simulator::reset() {
+    if (pagedMem != NULL) {
+        pagedMem->reset();
+    }
+    translations.revalidate();
+    if (devices != NULL) {
+        devices->reset();
+    }
+    if (syscalls != NULL) {
+        syscalls->reset(imageLength);
+    }
+
+    regData.reg = {};
+    PC = 0;
+    status = SIM_RUNNING;
+    instructionCount = 0;
+}
+
+void Simulator::setSyscalls(SyscallEmulator *s) {
+    syscalls = s;
+    if (syscalls != NULL) {
+        syscalls->reset(imageLength);
+    }
+}
+
+bool Simulator::setDevices(DeviceBus *bus) {
+    if (pagedMem == NULL) {
+        return false;
+    }
+    devices = bus;
+    pagedMem->setDevices(bus);
+    if (bus != NULL) {
+        bus->setClock(&instructionCount);
+    }
+    return true;
+}
+
+// Marks breakpoints in the translation table and protects watched pages, both of
+// which a load may have replaced.
+void Simulator::markDebugTargets() {
+    for (set<uint64_t>::iterator b = breakpoints.begin(); b != breakpoints.end(); ++b) {
+        translations.setBreakpoint(*b, true);
+    }
+    if (pagedMem != NULL) {
+        pagedMem->unprotectAll();
+        for (size_t w = 0; w < watchpoints.size(); w++) {
+            uint64_t last = (watchpoints[w].address + watchpoints[w].size - 1) >> MEM_PAGE_SHIFT;
+            for (uint64_t page = watchpoints[w].address >> MEM_PAGE_SHIFT; page <= last; page++) {
+                pagedMem->protectPage(page);
+            }
+        }
+    }
+}
+
+void Simulator::addBreakpoint(uint64_t pc) {
+    breakpoints.insert(pc);
+    translations.setBreakpoint(pc, true);
+}
+
+bool Simulator::removeBreakpoint(uint64_t pc) {
+    if (breakpoints.erase(pc) == 0) {
+        return false;
+    }
+    translations.setBreakpoint(pc, false);
+    return true;
+}
+
+bool Simulator::addWatchpoint(uint64_t address, uint64_t size) {
+    if (pagedMem == NULL || size == 0 || address + size > MEMORY_SIZE || address + size < address) {
+        return false;
+    }
+    Watchpoint w = { address, size };
+    watchpoints.push_back(w);
+    markDebugTargets();
+    return true;
+}
+
+bool Simulator::removeWatchpoint(uint64_t address) {
+    for (size_t w = 0; w < watchpoints.size(); w++) {
+        if (watchpoints[w].address == address) {
+            watchpoints.erase(watchpoints.begin() + w);
+            markDebugTargets();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Simulator::isWatched(uint64_t address, uint64_t size) const {
+    for (size_t w = 0; w < watchpoints.size(); w++) {
+        if (address < watchpoints[w].address + watchpoints[w].size && watchpoints[w].address < address + size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SimStatus Simulator::step() {
+    if (status != SIM_RUNNING) {
+        if (status != SIM_BREAKPOINT && status != SIM_WATCHPOINT) {
+            return status;
+        }
+        if (status == SIM_BREAKPOINT) {
+            skipBreakpointAt = PC;
+        }
+        status = SIM_RUNNING;
+    }
+
+    Instruction inst;
+    const Instruction *predecoded = translations.lookup(PC);
+    if (predecoded != NULL) {
+        inst = *predecoded;
+    }
+    else {
+        if (!breakpoints.empty() && breakpoints.count(PC) != 0) {
+            if (PC != skipBreakpointAt) {
+                status = SIM_BREAKPOINT;
+                return status;
+            }
+            skipBreakpointAt = UINT64_MAX;
+        }
+        inst = simFetch(PC, mem);
+        inst = simDecode(inst);
+    }
+    if (undo != NULL && !inst.isHalt && (inst.isLegal || inst.isNop)) {
+        undo->record(inst, regData, mem, instructionCount);
+    }
+    inst = simExecute(inst, PC, mem, regData);
+    lastInst = inst;
+    if (coverage != NULL) {
+        coverage->record(inst);
+    }
+
+    if (inst.isHalt) {
+        status = SIM_HALTED;
+    }
+    else if (!inst.isLegal && !inst.isNop) {
+        status = SIM_ILLEGAL;
+    }
+    else {
+        if (inst.writesMem) {
+            // the stored bytes may hold predecoded instructions
+            translations.invalidate(inst.memAddress, 1ULL << inst.funct3);
+        }
+        if (profiler != NULL) {
+            profiler->record(inst);
+        }
+        if (stats != NULL) {
+            stats->record(inst);
+        }
+        if (analysis != NULL) {
+            analysis->publish(inst);
+        }
+        if (inst.isEcall) {
+            systemCall();
+        }
+        instructionCount++;
+
+        uint64_t address, size;
+        if (!watchpoints.empty() && pagedMem->takeProtectedStore(address, size) && isWatched(address, size)) {
+            status = SIM_WATCHPOINT;
+        }
+    }
+    return status;
+}
+
+SimStatus Simulator::run(uint64_t maxInstructions) {
+    if (devices != NULL) {
+        runWithDevices(maxInstructions);
+    }
+    else {
+        // the first step resumes from a breakpoint or watchpoint stop
+        for (uint64_t i = 0; i < maxInstructions; i++) {
+            if (step() != SIM_RUNNING) {
+                break;
+            }
+        }
+    }
+    if (stats != NULL) {
+        stats->publish(*this);
+    }
+    return status;
+}
+
+bool Simulator::findSpin(uint64_t window) {
+    if (pagedMem == NULL || status != SIM_RUNNING) {
+        return false;
+    }
+    uint64_t startPC = PC;
+    REGS startRegs = regData;
+    spinMemory.assign(pagedMem->data(), pagedMem->data() + MEMORY_SIZE);
+    for (uint64_t i = 0; i < window; i++) {
+        // device events fall due on time, as in runWithDevices
+        if (devices != NULL && instructionCount >= devices->getScheduler().nextTime()) {
+            devices->getScheduler().runDue(instructionCount);
+        }
+        if (step() != SIM_RUNNING) {
+            return false;
+        }
+        // input and devices can change what the same state does next time
+        if (lastInst.isEcall || ((lastInst.readsMem || lastInst.writesMem) && lastInst.memAddress >= MEMORY_SIZE)) {
+            return false;
+        }
+        if (PC == startPC && memcmp(regData.registers, startRegs.registers, sizeof(startRegs.registers)) == 0 &&
+            memcmp(pagedMem->data(), spinMemory.data(), MEMORY_SIZE) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Simulator::setReg(unsigned index, uint64_t value) {
+    if (index != 0 && index < REG_SIZE) {
+        regData.registers[index] = value;
+    }
+}
+
+void Simulator::systemCall() {
+    if (syscalls == NULL) {
+        regData.reg.a0 = (uint64_t)-SYS_ENOSYS;
+        return;
+    }
+    if (!syscalls->handle(regData, mem)) {
+        status = SIM_HALTED;
+    }
+    if (syscalls->getWrittenLength() > 0) {
+        translations.invalidate(syscalls->getWrittenAddress(), syscalls->getWrittenLength());
+    }
+}
+
+// Runs blocks of instructions up to the next device event, then the events due.
+// A device access within a block may schedule an earlier event, which ends it.
+SimStatus Simulator::runWithDevices(uint64_t maxInstructions) {
+    EventScheduler &events = devices->getScheduler();
+    for (uint64_t i = 0; i < maxInstructions; ) {
+        events.runDue(instructionCount);
+        for (; i < maxInstructions && instructionCount < events.nextTime(); i++) {
+            if (step() != SIM_RUNNING) {
+                return status;
+            }
+        }
+    }
+    return status;
+}
+
+int Simulator::readMemory(uint64_t address, uint64_t &value, MemEntrySize size) {
+    return mem->getMemValue(address, value, size);
+}
+
+int Simulator::writeMemory(uint64_t address, uint64_t value, MemEntrySize size) {
+    translations.invalidate(address, size);
+    int result = mem->setMemValue(address, value, size);
+    uint64_t protectedAddress, protectedSize;
+    if (!watchpoints.empty()) {
+        // writes from outside the program, such as undoing, do not trigger watchpoints
+        pagedMem->takeProtectedStore(protectedAddress, protectedSize);
+    }
+    return result;
+}
+
+void Simulator::dump() {
+    ::dump(regData, mem);
+}
+
+bool Simulator::dumpBinary(FILE *f, DumpKind kind) {
+    return writeDumpRecord(f, kind, regData, PC, instructionCount, mem);
+}
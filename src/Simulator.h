@@ -0,0 +1,197 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <set>
+
+#include "sim.h"
+#include "PagedMemoryStore.h"
+#include "TranslationCache.h"
+#include "BinaryDump.h"
+
+class Profiler;
+class AnalysisPipeline;
+class UndoLog;
+class DeviceBus;
+class SyscallEmulator;
+class LiveStats;
+class Coverage;
+
+// Instructions Simulator::findSpin looks ahead for a repeated state.
+#define SPIN_WINDOW 256
+
+// Why a simulator stopped running.
+enum SimStatus {
+    SIM_RUNNING = 0, // can keep going; run() used up its instruction budget
+    SIM_HALTED,      // reached the 0xfeedfeed halt word
+    SIM_ILLEGAL,     // illegal instruction at getPC()
+    SIM_BREAKPOINT,  // about to execute the breakpoint at getPC(); running resumes
+    SIM_WATCHPOINT   // the last instruction stored to a watched address; running resumes
+};
+
+// One simulated RV64I hart and its memory. All state lives in the object, so any
+// number of simulators can run side by side in one process. Nothing in here prints
+// or exits; the caller decides what a halt or an illegal instruction means.
+class Simulator
+{
+    public:
+        // Simulates on mem if given (the caller keeps ownership), otherwise on a
+        // PagedMemoryStore taken from this thread's MemoryImagePool.
+        explicit Simulator(MemoryStore *mem = NULL);
+        ~Simulator();
+
+        // Predecoded instruction tables, see TranslationCache. Enabled without
+        // a cache directory by default; takes effect on the next load.
+        void setTranslationCache(bool enabled, const std::string &cacheDir = "",
+                                 uint64_t sizeCap = TRANSLATION_CACHE_DEFAULT_CAP);
+
+        // Reports every executed instruction to profiler, if not NULL. The caller
+        // keeps ownership.
+        void setProfiler(Profiler *p) { profiler = p; }
+
+        // Publishes every executed instruction to analysis, if not NULL. The
+        // caller keeps ownership and finishes the pipeline after the run.
+        void setAnalysis(AnalysisPipeline *a) { analysis = a; }
+
+        // Records how to take back every instruction in undo, if not NULL. The
+        // caller keeps ownership and clears the log when reloading.
+        void setUndoLog(UndoLog *u) { undo = u; }
+
+        // Counts the instruction mix of every executed instruction in stats and
+        // publishes it at the end of every run, if not NULL. The caller keeps
+        // ownership.
+        void setLiveStats(LiveStats *s) { stats = s; }
+
+        // Marks the coverage point of every executed instruction, halts and
+        // illegal instructions included, in coverage, if not NULL. The caller
+        // keeps ownership.
+        void setCoverage(Coverage *c) { coverage = c; }
+
+        // Performs the system calls of ecall instructions, if not NULL; without
+        // it every call fails with ENOSYS. The caller keeps ownership.
+        void setSyscalls(SyscallEmulator *s);
+        SyscallEmulator *getSyscalls() { return syscalls; }
+
+        // Maps devices outside RAM and runs their events, if not NULL. The caller
+        // keeps ownership. Needs a PagedMemoryStore; returns false otherwise.
+        bool setDevices(DeviceBus *bus);
+
+        // Stops a run with SIM_BREAKPOINT before the instruction at pc executes.
+        // Only the translation cache entry for pc is marked, so that it misses and
+        // the fetch path behind it checks the breakpoints; other code runs as fast
+        // as without breakpoints.
+        void addBreakpoint(uint64_t pc);
+        bool removeBreakpoint(uint64_t pc);
+        bool hasBreakpoint(uint64_t pc) const { return breakpoints.count(pc) != 0; }
+        const std::set<uint64_t> &getBreakpoints() const { return breakpoints; }
+
+        // Lets the next step execute the instruction at getPC() even if it is a
+        // breakpoint, for continuing from a breakpoint reached by rewind. Resuming
+        // after SIM_BREAKPOINT does this by itself.
+        void skipBreakpoint() { skipBreakpointAt = hasBreakpoint(PC) ? PC : UINT64_MAX; }
+
+        // Stops a run with SIM_WATCHPOINT after a store writes any byte of
+        // [address, address + size). The pages are write protected in the memory
+        // store, so stores elsewhere cost a bit test. Needs a PagedMemoryStore.
+        bool addWatchpoint(uint64_t address, uint64_t size);
+        bool removeWatchpoint(uint64_t address);
+        bool isWatched(uint64_t address, uint64_t size) const;
+
+        // Loads a program at address 0 and resets registers, PC and status.
+        bool load(const char *programFile);
+        void load(const std::vector<uint8_t> &image);
+
+        // Puts the loaded program back in its just-loaded state. Only the memory
+        // pages written since are restored, which requires a PagedMemoryStore.
+        void reset();
+
+        // Executes one instruction.
+        SimStatus step();
+
+        // Executes up to maxInstructions instructions, stopping early on halt, an
+        // illegal instruction, a breakpoint or a watchpoint.
+        SimStatus run(uint64_t maxInstructions);
+
+        // Steps up to window instructions looking for a return to the current
+        // state: the same PC, registers and memory, reached without a system
+        // call or device access on the way. From there the program can only
+        // repeat itself forever, so this returns true and leaves the simulator
+        // at that state; otherwise it returns false having run the instructions
+        // like run() would, device events included. Catches branches to self and
+        // short loops that change nothing. Needs a PagedMemoryStore.
+        bool findSpin(uint64_t window = SPIN_WINDOW);
+
+        SimStatus getStatus() const { return status; }
+        uint64_t getInstructionCount() const { return instructionCount; }
+        uint64_t getImageLength() const { return imageLength; }
+
+        // The instruction most recently stepped, including a halt or illegal one.
+        const Instruction &getLastInstruction() const { return lastInst; }
+
+        uint64_t getPC() const { return PC; }
+        void setPC(uint64_t pc) { PC = pc; }
+
+        // Goes back to before instruction number instructionCount, at pc, for
+        // UndoLog. Registers and memory are the caller's to restore.
+        void rewind(uint64_t pc, uint64_t instructionCount) {
+            PC = pc;
+            this->instructionCount = instructionCount;
+            status = SIM_RUNNING;
+        }
+
+        uint64_t getReg(unsigned index) const { return regData.registers[index % REG_SIZE]; }
+        void setReg(unsigned index, uint64_t value);
+        RegisterInfo &getRegisters() { return regData.reg; }
+
+        int readMemory(uint64_t address, uint64_t &value, MemEntrySize size);
+        int writeMemory(uint64_t address, uint64_t value, MemEntrySize size);
+        MemoryStore *getMemory() { return mem; }
+
+        // Writes reg_state.out and mem_state.out to the current directory.
+        void dump();
+
+        // Appends a binary dump record to f, see BinaryDump.h.
+        bool dumpBinary(FILE *f, DumpKind kind);
+
+    private:
+        struct Watchpoint {
+            uint64_t address;
+            uint64_t size;
+        };
+
+        Simulator(const Simulator &) = delete;
+        Simulator &operator=(const Simulator &) = delete;
+        void markDebugTargets();
+        SimStatus runWithDevices(uint64_t maxInstructions);
+        void systemCall();
+
+        REGS regData;
+        uint64_t PC;
+        MemoryStore *mem;
+        PagedMemoryStore *pagedMem; // mem, if it tracks dirty pages
+        bool ownsMem;
+
+        SimStatus status;
+        uint64_t instructionCount;
+        Instruction lastInst;
+
+        bool useTranslations;
+        std::string translationDir;
+        uint64_t translationCap;
+        TranslationCache translations;
+
+        Profiler *profiler;
+        AnalysisPipeline *analysis;
+        UndoLog *undo;
+        LiveStats *stats;
+        Coverage *coverage;
+        DeviceBus *devices;
+        SyscallEmulator *syscalls;
+        uint64_t imageLength;
+
+        std::set<uint64_t> breakpoints;
+        uint64_t skipBreakpointAt;
+        std::vector<Watchpoint> watchpoints;
+        std::vector<uint8_t> spinMemory; // findSpin's copy of memory at the start
+};
+
+#endif
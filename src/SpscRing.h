@@ -0,0 +1,88 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+// Keeps the producer's and the consumer's fields on separate cache lines.
+#define SPSC_CACHE_LINE 64
+
+// A bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Each side caches the other's position and only rereads it when the
+// ring looks full (or empty), so a batch costs two atomic operations.
+template <typename T>
+class SpscRing
+{
+    public:
+        // capacity is rounded up to a power of two
+        explicit SpscRing(size_t capacity) : head(0), tail(0), cachedHead(0), cachedTail(0) {
+            size_t size = 1;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            slots.resize(size);
+            mask = size - 1;
+        }
+
+        // Producer: copies in as many of items as fit and returns how many did.
+        size_t push(const T *items, size_t count) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t space = slots.size() - (t - cachedHead);
+            if (space < count) {
+                cachedHead = head.load(std::memory_order_acquire);
+                space = slots.size() - (t - cachedHead);
+            }
+            size_t n = count < space ? count : space;
+            for (size_t i = 0; i < n; i++) {
+                slots[(t + i) & mask] = items[i];
+            }
+            tail.store(t + n, std::memory_order_release);
+            return n;
+        }
+
+        // Consumer: points items at the oldest queued elements and returns how
+        // many are contiguous there (0 if the ring is empty). Release them with pop.
+        size_t peek(const T *&items) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (cachedTail == h) {
+                cachedTail = tail.load(std::memory_order_acquire);
+                if (cachedTail == h) {
+                    return 0;
+                }
+            }
+            size_t start = h & mask;
+            size_t n = cachedTail - h;
+            if (n > slots.size() - start) {
+                n = slots.size() - start;
+            }
+            items = &slots[start];
+            return n;
+        }
+
+        void pop(size_t count) {
+            head.store(head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+        }
+
+        bool empty() const {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        SpscRing(const SpscRing &) = delete;
+        SpscRing &operator=(const SpscRing &) = delete;
+
+        std::vector<T> slots;
+        size_t mask;
+
+        char pad0[SPSC_CACHE_LINE];
+        std::atomic<size_t> head; // written by the consumer
+        char pad1[SPSC_CACHE_LINE];
+        std::atomic<size_t> tail; // written by the producer
+        char pad2[SPSC_CACHE_LINE];
+        size_t cachedHead;        // producer's copy of head
+        char pad3[SPSC_CACHE_LINE];
+        size_t cachedTail;        // consumer's copy of tail
+};
+
+#endif
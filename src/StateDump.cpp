@@ -0,0 +1,89 @@
+#include "StateDump.h"
+
+using namespace std;
+
+static const char *DUMP_RULE = "---------------------\n";
+
+// ABI names in dump order; an empty name marks the blank line between groups
+static const char *DUMP_REG_NAMES[] = {
+    "ra", "sp", "gp", "tp", "",
+    "t0", "t1", "t2", "",
+    "s0", "s1", "",
+    "a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7", "",
+    "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "",
+    "t3", "t4", "t5", "t6"
+};
+
+void formatRegisterState(const RegisterInfo &reg, string &out) {
+    const uint64_t *regs = (const uint64_t *)&reg;
+    char line[64];
+
+    out += DUMP_RULE;
+    out += "Begin Register Values\n";
+    out += DUMP_RULE;
+    unsigned index = 1; // x0 is not dumped
+    for (size_t i = 0; i < sizeof(DUMP_REG_NAMES) / sizeof(DUMP_REG_NAMES[0]); i++) {
+        if (DUMP_REG_NAMES[i][0] == '\0') {
+            out += "\n";
+            continue;
+        }
+        snprintf(line, sizeof(line), "$%s = 0x%016llx\n",
+                 DUMP_REG_NAMES[i], (unsigned long long)regs[index++]);
+        out += line;
+    }
+    out += DUMP_RULE;
+    out += "End Register Values\n";
+    out += DUMP_RULE;
+}
+
+void formatMemoryRange(MemoryStore *mem, uint64_t startAddress, uint64_t endAddress, string &out) {
+    const uint64_t wordsPerLine = 5;
+    char text[32];
+
+    for (uint64_t addr = startAddress; addr < endAddress; addr += wordsPerLine * WORD_SIZE) {
+        snprintf(text, sizeof(text), "0x%08llx: ", (unsigned long long)addr);
+        out += text;
+        for (uint64_t w = 0; w < wordsPerLine; w++) {
+            // bytes are shown in address order, not as a little-endian word
+            uint64_t word = 0;
+            mem->getMemValue(addr + w * WORD_SIZE, word, WORD_SIZE);
+            snprintf(text, sizeof(text), "0x%02x%02x%02x%02x ",
+                     (unsigned)(word & 0xff), (unsigned)((word >> 8) & 0xff),
+                     (unsigned)((word >> 16) & 0xff), (unsigned)((word >> 24) & 0xff));
+            out += text;
+        }
+        out += "\n";
+    }
+}
+
+void formatMemoryState(MemoryStore *mem, string &out) {
+    out += DUMP_RULE;
+    out += "Begin Memory State\n";
+    out += DUMP_RULE;
+    formatMemoryRange(mem, MEM_DUMP_START, MEM_DUMP_END, out);
+    out += DUMP_RULE;
+    out += "End Memory State\n";
+    out += DUMP_RULE;
+}
+
+void writeStateFiles(const RegisterInfo &reg, MemoryStore *mem, const char *regFile, const char *memFile) {
+    string text;
+    formatRegisterState(reg, text);
+    FILE *f = fopen(regFile, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Could not create register state dump file\n");
+        return;
+    }
+    fwrite(text.data(), 1, text.size(), f);
+    fclose(f);
+
+    text.clear();
+    formatMemoryState(mem, text);
+    f = fopen(memFile, "w");
+    if (f == NULL) {
+        fprintf(stderr, "[ERROR] Could not create memory state dump file\n");
+        return;
+    }
+    fwrite(text.data(), 1, text.size(), f);
+    fclose(f);
+}
@@ -0,0 +1,26 @@
+#ifndef STATE_DUMP_H
+#define STATE_DUMP_H
+
+#include <string>
+
+#include "sim.h"
+
+// The address range covered by a memory state dump.
+#define MEM_DUMP_START 0x0
+#define MEM_DUMP_END   0x1f4
+
+// Appends the text that dumpRegisterState writes to reg_state.out.
+void formatRegisterState(const RegisterInfo &reg, std::string &out);
+
+// Appends the text that dumpMemoryState writes to mem_state.out.
+void formatMemoryState(MemoryStore *mem, std::string &out);
+
+// Appends the lines of a memory dump covering [startAddress, endAddress).
+void formatMemoryRange(MemoryStore *mem, uint64_t startAddress, uint64_t endAddress, std::string &out);
+
+// Writes reg_state.out and mem_state.out (by default to the current directory).
+// Unlike dumpMemoryState this works with any MemoryStore implementation.
+void writeStateFiles(const RegisterInfo &reg, MemoryStore *mem,
+                     const char *regFile = "reg_state.out", const char *memFile = "mem_state.out");
+
+#endif
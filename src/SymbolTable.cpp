@@ -0,0 +1,123 @@
+#include "SymbolTable.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <elf.h>
+#include <algorithm>
+
+using namespace std;
+
+// Reads the whole of path into data.
+static bool readFile(const char *path, vector<uint8_t> &data) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data.resize(size > 0 ? size : 0);
+    bool ok = size > 0 && fread(data.data(), 1, data.size(), f) == data.size();
+    fclose(f);
+    return ok;
+}
+
+// Assembler-internal names that do not help anyone reading a profile.
+static bool isUsefulName(const char *name) {
+    return name[0] != '\0' && name[0] != '$' && strncmp(name, ".L", 2) != 0;
+}
+
+bool SymbolTable::loadElf(const char *elfFile) {
+    vector<uint8_t> data;
+    if (!readFile(elfFile, data)) {
+        return false;
+    }
+
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)data.data();
+    if (data.size() < sizeof(Elf64_Ehdr) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 ||
+        eh->e_ident[EI_CLASS] != ELFCLASS64 || eh->e_ident[EI_DATA] != ELFDATA2LSB ||
+        eh->e_shentsize != sizeof(Elf64_Shdr) ||
+        eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(Elf64_Shdr) > data.size() ||
+        eh->e_shstrndx >= eh->e_shnum) {
+        fprintf(stderr, "%s: not a little-endian ELF64 file\n", elfFile);
+        return false;
+    }
+    const Elf64_Shdr *sections = (const Elf64_Shdr *)&data[eh->e_shoff];
+    const Elf64_Shdr &names = sections[eh->e_shstrndx];
+
+    unsigned text = 0;
+    for (unsigned i = 1; i < eh->e_shnum && names.sh_offset + sections[i].sh_name < data.size(); i++) {
+        if (strcmp((const char *)&data[names.sh_offset + sections[i].sh_name], ".text") == 0) {
+            text = i;
+            break;
+        }
+    }
+    if (text == 0) {
+        fprintf(stderr, "%s: no .text section\n", elfFile);
+        return false;
+    }
+
+    // function symbols win over plain labels at the same address, globals over locals
+    struct Candidate {
+        uint64_t address;
+        int rank;
+        string name;
+        bool operator<(const Candidate &other) const {
+            return address != other.address ? address < other.address : rank > other.rank;
+        }
+    };
+    vector<Candidate> candidates;
+
+    for (unsigned i = 1; i < eh->e_shnum; i++) {
+        const Elf64_Shdr &symtab = sections[i];
+        if (symtab.sh_type != SHT_SYMTAB || symtab.sh_link >= eh->e_shnum ||
+            symtab.sh_offset + symtab.sh_size > data.size()) {
+            continue;
+        }
+        const Elf64_Shdr &strtab = sections[symtab.sh_link];
+        const Elf64_Sym *syms = (const Elf64_Sym *)&data[symtab.sh_offset];
+        for (uint64_t s = 0; s < symtab.sh_size / sizeof(Elf64_Sym); s++) {
+            unsigned type = ELF64_ST_TYPE(syms[s].st_info);
+            if (syms[s].st_shndx != text || (type != STT_FUNC && type != STT_NOTYPE) ||
+                strtab.sh_offset + syms[s].st_name >= data.size()) {
+                continue;
+            }
+            const char *name = (const char *)&data[strtab.sh_offset + syms[s].st_name];
+            if (!isUsefulName(name)) {
+                continue;
+            }
+            int rank = (type == STT_FUNC ? 2 : 0) + (ELF64_ST_BIND(syms[s].st_info) != STB_LOCAL ? 1 : 0);
+            candidates.push_back({syms[s].st_value - sections[text].sh_addr, rank, name});
+        }
+    }
+
+    sort(candidates.begin(), candidates.end());
+    symbols.clear();
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (symbols.empty() || symbols.back().address != candidates[i].address) {
+            symbols.push_back({candidates[i].address, candidates[i].name});
+        }
+    }
+    return true;
+}
+
+const SymbolTable::Symbol *SymbolTable::find(uint64_t address) const {
+    vector<Symbol>::const_iterator it = upper_bound(symbols.begin(), symbols.end(), address,
+        [](uint64_t a, const Symbol &s) { return a < s.address; });
+    return it == symbols.begin() ? NULL : &*(it - 1);
+}
+
+string SymbolTable::describe(uint64_t address) const {
+    char text[32];
+    const Symbol *symbol = find(address);
+    if (symbol == NULL) {
+        snprintf(text, sizeof(text), "0x%lx", address);
+        return text;
+    }
+    if (symbol->address == address) {
+        return symbol->name;
+    }
+    snprintf(text, sizeof(text), "+0x%lx", address - symbol->address);
+    return symbol->name + text;
+}
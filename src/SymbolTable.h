@@ -0,0 +1,33 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Code addresses named from an ELF symbol table. Addresses are relative to the
+// start of .text, which is where the simulator loads the objcopied binary.
+class SymbolTable
+{
+    public:
+        struct Symbol {
+            uint64_t address;
+            std::string name;
+        };
+
+        // Reads the function and label symbols of .text from an ELF64 file.
+        bool loadElf(const char *elfFile);
+
+        bool empty() const { return symbols.empty(); }
+
+        // The closest symbol at or below address, or NULL if there is none.
+        const Symbol *find(uint64_t address) const;
+
+        // "name", "name+0x1c", or just the hex address when no symbol covers it.
+        std::string describe(uint64_t address) const;
+
+    private:
+        std::vector<Symbol> symbols; // sorted by address, one per address
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "Syscalls.h"
+#include "PagedMemoryStore.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Bytes taken from the host per guest read at most; guests loop for more, as on Linux.
+static const uint64_t READ_CHUNK = 4096;
+
+static bool inGuestMemory(uint64_t address, uint64_t length) {
+    return address + length <= MEMORY_SIZE && address + length >= address;
+}
+
+SyscallEmulator::SyscallEmulator(HostOutput &out, HostOutput &err, int inFd)
+    : out(out), err(err), inFd(inFd) {
+    reset(0);
+}
+
+void SyscallEmulator::reset(uint64_t imageLength) {
+    heapStart = (imageLength + 7) & ~7ULL;
+    programBreak = heapStart;
+    exited = false;
+    exitCode = 0;
+    writtenAddress = 0;
+    writtenLength = 0;
+}
+
+bool SyscallEmulator::handle(REGS &regs, MemoryStore *mem) {
+    RegisterInfo &r = regs.reg;
+    writtenLength = 0;
+    int64_t result;
+    switch (r.a7) {
+        case SYS_READ:
+            result = read(mem, r.a0, r.a1, r.a2);
+            break;
+        case SYS_WRITE:
+            result = write(mem, r.a0, r.a1, r.a2);
+            break;
+        case SYS_EXIT:
+        case SYS_EXIT_GROUP:
+            exited = true;
+            exitCode = (int)(r.a0 & 0xff);
+            return false;
+        case SYS_BRK:
+            result = brk(r.a0);
+            break;
+        default:
+            result = -SYS_ENOSYS;
+            break;
+    }
+    r.a0 = (uint64_t)result;
+    return true;
+}
+
+int64_t SyscallEmulator::write(MemoryStore *mem, uint64_t fd, uint64_t buffer, uint64_t count) {
+    if (fd != 1 && fd != 2) {
+        return -SYS_EBADF;
+    }
+    if (!inGuestMemory(buffer, count)) {
+        return -SYS_EFAULT;
+    }
+    HostOutput &target = fd == 1 ? out : err;
+    PagedMemoryStore *paged = dynamic_cast<PagedMemoryStore *>(mem);
+    if (paged != NULL) {
+        target.write(paged->data() + buffer, count);
+    }
+    else {
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t byte = 0;
+            mem->getMemValue(buffer + i, byte, BYTE_SIZE);
+            target.put((uint8_t)byte);
+        }
+    }
+    return count;
+}
+
+int64_t SyscallEmulator::read(MemoryStore *mem, uint64_t fd, uint64_t buffer, uint64_t count) {
+    if (fd != 0) {
+        return -SYS_EBADF;
+    }
+    if (!inGuestMemory(buffer, count)) {
+        return -SYS_EFAULT;
+    }
+    if (inFd < 0 || count == 0) {
+        return 0;
+    }
+    // a prompt written before the read should be on the screen while it waits
+    out.flush();
+    err.flush();
+
+    uint8_t data[READ_CHUNK];
+    ssize_t n;
+    do {
+        n = ::read(inFd, data, count < READ_CHUNK ? count : READ_CHUNK);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return -errno;
+    }
+    for (ssize_t i = 0; i < n; i++) {
+        mem->setMemValue(buffer + i, data[i], BYTE_SIZE);
+    }
+    writtenAddress = buffer;
+    writtenLength = n;
+    return n;
+}
+
+// Linux semantics: a break outside the heap is refused by returning the old one.
+int64_t SyscallEmulator::brk(uint64_t address) {
+    if (address >= heapStart && address <= MEMORY_SIZE) {
+        programBreak = address;
+    }
+    return programBreak;
+}
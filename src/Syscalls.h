@@ -0,0 +1,63 @@
+#ifndef SYSCALLS_H
+#define SYSCALLS_H
+
+#include "sim.h"
+#include "Devices.h"
+
+// Linux RV64 system call numbers, in a7.
+#define SYS_READ       63
+#define SYS_WRITE      64
+#define SYS_EXIT       93
+#define SYS_EXIT_GROUP 94
+#define SYS_BRK        214
+
+// Guest memory is small; these are the Linux error numbers returned (negated) in a0.
+#define SYS_EBADF  9
+#define SYS_EFAULT 14
+#define SYS_ENOSYS 38
+
+// Emulates the handful of Linux system calls a bare program needs: read from fd 0,
+// write to fds 1 and 2, exit and brk. Guest writes are collected in HostOutputs and
+// reach the host in large writes, not one host call per guest call.
+class SyscallEmulator
+{
+    public:
+        // Guest fds 1 and 2 go to out and err; fd 0 reads from inFd, or is always
+        // at end of file if inFd is negative.
+        SyscallEmulator(HostOutput &out, HostOutput &err, int inFd);
+
+        // For a freshly loaded program of imageLength bytes, whose heap starts
+        // right after it.
+        void reset(uint64_t imageLength);
+
+        // Performs the call an ecall just made: number in a7, arguments from a0,
+        // result to a0. Returns false once the program has exited.
+        bool handle(REGS &regs, MemoryStore *mem);
+
+        bool hasExited() const { return exited; }
+        int getExitCode() const { return exitCode; }
+
+        uint64_t getBreak() const { return programBreak; }
+        void setBreak(uint64_t address) { programBreak = address; }
+
+        // Guest memory the last call wrote, whose predecoded instructions are stale.
+        uint64_t getWrittenAddress() const { return writtenAddress; }
+        uint64_t getWrittenLength() const { return writtenLength; }
+
+    private:
+        int64_t write(MemoryStore *mem, uint64_t fd, uint64_t buffer, uint64_t count);
+        int64_t read(MemoryStore *mem, uint64_t fd, uint64_t buffer, uint64_t count);
+        int64_t brk(uint64_t address);
+
+        HostOutput &out;
+        HostOutput &err;
+        int inFd;
+        uint64_t heapStart;
+        uint64_t programBreak;
+        bool exited;
+        int exitCode;
+        uint64_t writtenAddress;
+        uint64_t writtenLength;
+};
+
+#endif
@@ -0,0 +1,248 @@
+#include "TranslationCache.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <algorithm>
+
+using namespace std;
+
+// On-disk layout: header, a copy of the program image (to validate against the
+// bytes actually loaded), then the Instruction entries at entriesOffset.
+static const char TC_MAGIC[8] = {'R', 'V', 'S', 'I', 'M', 'T', 'C', 0};
+// Bump whenever decoding changes, so tables from older builds are not mapped back in.
+static const uint32_t TC_VERSION = 6;
+
+struct TranslationCacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t entrySize;      // sizeof(Instruction) of the writer
+    uint64_t imageHash;
+    uint64_t imageLength;
+    uint64_t numEntries;
+    uint64_t entriesOffset;
+};
+
+uint64_t hashImage(const uint8_t *data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+string defaultTranslationCacheDir() {
+    const char *home = getenv("HOME");
+    if (home == NULL || home[0] == '\0') {
+        return "";
+    }
+    return string(home) + "/.cache/riscv-sim";
+}
+
+static uint64_t entriesOffsetFor(uint64_t imageLength) {
+    uint64_t offset = sizeof(TranslationCacheHeader) + imageLength;
+    return (offset + 63) & ~63ULL;
+}
+
+// mkdir -p
+static bool makeDirs(const string &dir) {
+    for (size_t i = 1; i <= dir.size(); i++) {
+        if (i == dir.size() || dir[i] == '/') {
+            string prefix = dir.substr(0, i);
+            if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Removes the least recently used tables until the directory fits in sizeCap.
+// The table at keep was just written and is never evicted.
+static void evictTables(const string &cacheDir, uint64_t sizeCap, const string &keep) {
+    struct Table {
+        time_t   mtime;
+        uint64_t size;
+        string   path;
+        bool operator<(const Table &other) const { return mtime < other.mtime; }
+    };
+
+    DIR *dir = opendir(cacheDir.c_str());
+    if (dir == NULL) {
+        return;
+    }
+    vector<Table> tables;
+    uint64_t total = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        size_t len = strlen(ent->d_name);
+        if (len < 3 || strcmp(ent->d_name + len - 3, ".tc") != 0) {
+            continue;
+        }
+        Table table;
+        table.path = cacheDir + "/" + ent->d_name;
+        struct stat st;
+        if (stat(table.path.c_str(), &st) != 0) {
+            continue;
+        }
+        table.mtime = st.st_mtime;
+        table.size = st.st_size;
+        total += table.size;
+        tables.push_back(table);
+    }
+    closedir(dir);
+
+    sort(tables.begin(), tables.end());
+    for (size_t i = 0; i < tables.size() && total > sizeCap; i++) {
+        if (tables[i].path == keep) {
+            continue;
+        }
+        if (unlink(tables[i].path.c_str()) == 0) {
+            total -= tables[i].size;
+        }
+    }
+}
+
+TranslationCache::TranslationCache()
+    : entries(NULL), numEntries(0), invalidated(false), mapping(NULL), mappingSize(0) {}
+
+TranslationCache::~TranslationCache() {
+    clear();
+}
+
+void TranslationCache::clear() {
+    if (mapping != NULL) {
+        munmap(mapping, mappingSize);
+        mapping = NULL;
+        mappingSize = 0;
+    }
+    entries = NULL;
+    numEntries = 0;
+    state.clear();
+    invalidated = false;
+    decoded.clear();
+    loadedImage.clear();
+}
+
+void TranslationCache::load(const vector<uint8_t> &image, const string &cacheDir, uint64_t sizeCap) {
+    // reloading the same program only needs its invalidated entries back
+    if (numEntries > 0 && image == loadedImage) {
+        revalidate();
+        return;
+    }
+    clear();
+    loadedImage = image;
+
+    uint64_t hash = hashImage(image.data(), image.size());
+    string path;
+    if (!cacheDir.empty()) {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.tc", (unsigned long long)hash);
+        path = cacheDir + name;
+
+        if (mapFromDisk(path, image, hash)) {
+            // bump mtime so eviction sees this table as recently used
+            utimes(path.c_str(), NULL);
+            return;
+        }
+    }
+
+    // decode every parcel of the image as if it were fetched at that PC; memory
+    // after the image reads as zero
+    numEntries = image.size() / 2;
+    decoded.resize(numEntries);
+    for (uint64_t i = 0; i < numEntries; i++) {
+        uint32_t word = 0;
+        for (uint64_t b = 0; b < 4 && i * 2 + b < image.size(); b++) {
+            word |= (uint32_t)image[i * 2 + b] << (8 * b);
+        }
+        decoded[i] = simDecode(simFetchWord(i * 2, word));
+    }
+    entries = decoded.data();
+    state.assign(numEntries, TC_ENTRY_VALID);
+
+    if (!path.empty() && makeDirs(cacheDir) && storeToDisk(path, image, hash)) {
+        evictTables(cacheDir, sizeCap, path);
+    }
+}
+
+bool TranslationCache::mapFromDisk(const string &path, const vector<uint8_t> &image, uint64_t hash) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(TranslationCacheHeader)) {
+        close(fd);
+        return false;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    const TranslationCacheHeader *header = (const TranslationCacheHeader *)base;
+    const uint8_t *bytes = (const uint8_t *)base;
+    uint64_t expectedEntries = image.size() / 2;
+    bool ok = memcmp(header->magic, TC_MAGIC, sizeof(TC_MAGIC)) == 0
+           && header->version == TC_VERSION
+           && header->entrySize == sizeof(Instruction)
+           && header->imageHash == hash
+           && header->imageLength == image.size()
+           && header->numEntries == expectedEntries
+           && header->entriesOffset == entriesOffsetFor(image.size())
+           && (uint64_t)st.st_size >= header->entriesOffset + expectedEntries * sizeof(Instruction)
+           && memcmp(bytes + sizeof(TranslationCacheHeader), image.data(), image.size()) == 0;
+    if (!ok) {
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    mapping = base;
+    mappingSize = st.st_size;
+    entries = (const Instruction *)(bytes + header->entriesOffset);
+    numEntries = expectedEntries;
+    state.assign(numEntries, TC_ENTRY_VALID);
+    return true;
+}
+
+bool TranslationCache::storeToDisk(const string &path, const vector<uint8_t> &image, uint64_t hash) {
+    TranslationCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TC_MAGIC, sizeof(TC_MAGIC));
+    header.version = TC_VERSION;
+    header.entrySize = sizeof(Instruction);
+    header.imageHash = hash;
+    header.imageLength = image.size();
+    header.numEntries = numEntries;
+    header.entriesOffset = entriesOffsetFor(image.size());
+
+    // write to a private name and rename, so concurrent runs never map a partial table
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp%d", (int)getpid());
+    string tmpPath = path + suffix;
+    FILE *f = fopen(tmpPath.c_str(), "wb");
+    if (f == NULL) {
+        return false;
+    }
+    static const uint8_t padding[64] = {0};
+    uint64_t padLength = header.entriesOffset - sizeof(header) - image.size();
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+           && fwrite(image.data(), 1, image.size(), f) == image.size()
+           && fwrite(padding, 1, padLength, f) == padLength
+           && fwrite(entries, sizeof(Instruction), numEntries, f) == numEntries;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,103 @@
+#ifndef TRANSLATION_CACHE_H
+#define TRANSLATION_CACHE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "sim.h"
+
+// Translation tables larger than this in total are evicted least recently used first.
+#define TRANSLATION_CACHE_DEFAULT_CAP (64ULL << 20)
+
+// Per-entry state bits.
+#define TC_ENTRY_VALID 1 // decoded from the word memory still holds
+#define TC_ENTRY_BREAK 2 // breakpoint: lookup misses, so the checked fetch path runs
+
+// A table of predecoded instructions, one entry per 2-byte parcel of the program image,
+// since with compressed instructions any parcel may start one.
+// Tables are persisted in a cache directory under a hash of the image, so that a later
+// run of the same binary maps the table back in instead of decoding the image again.
+class TranslationCache
+{
+    public:
+        TranslationCache();
+        ~TranslationCache();
+
+        // Maps in the table for image from cacheDir, or decodes image and stores the
+        // table there. With an empty cacheDir the image is decoded without touching disk.
+        void load(const std::vector<uint8_t> &image, const std::string &cacheDir, uint64_t sizeCap);
+
+        // Drops the table; every lookup misses until the next load.
+        void clear();
+
+        // Brings back every entry dropped by invalidate.
+        void revalidate() {
+            if (invalidated) {
+                for (uint64_t i = 0; i < numEntries; i++) {
+                    state[i] |= TC_ENTRY_VALID;
+                }
+                invalidated = false;
+            }
+        }
+
+        // Returns the predecoded instruction at pc, or NULL if pc is outside the image,
+        // the instruction at pc has been stored to since it was decoded or pc is marked
+        // as a breakpoint.
+        const Instruction *lookup(uint64_t pc) const {
+            uint64_t index = pc >> 1;
+            if ((pc & 1) != 0 || index >= numEntries || state[index] != TC_ENTRY_VALID) {
+                return NULL;
+            }
+            return &entries[index];
+        }
+
+        // Marks or unmarks the entry at pc as a breakpoint. Breakpoints outside the
+        // image have no entry; every fetch there takes the checked path anyway.
+        void setBreakpoint(uint64_t pc, bool enabled) {
+            uint64_t index = pc >> 1;
+            if ((pc & 1) == 0 && index < numEntries) {
+                state[index] = enabled ? state[index] | TC_ENTRY_BREAK : state[index] & ~TC_ENTRY_BREAK;
+            }
+        }
+
+        // Drops the entries overlapping [address, address + size), called on stores.
+        // An entry covers up to 4 bytes from its parcel, so the one before address
+        // may reach into the store.
+        void invalidate(uint64_t address, uint64_t size) {
+            uint64_t first = address >= 2 ? (address - 2) >> 1 : 0;
+            if (first >= numEntries) {
+                return;
+            }
+            uint64_t last = (address + size - 1) >> 1;
+            for (uint64_t i = first; i <= last && i < numEntries; i++) {
+                state[i] &= ~TC_ENTRY_VALID;
+            }
+            invalidated = true;
+        }
+
+        // Whether the last load mapped an existing table from disk.
+        bool wasMapped() const { return mapping != NULL; }
+
+    private:
+        bool mapFromDisk(const std::string &path, const std::vector<uint8_t> &image, uint64_t hash);
+        bool storeToDisk(const std::string &path, const std::vector<uint8_t> &image, uint64_t hash);
+
+        const Instruction *entries;
+        uint64_t numEntries;
+        std::vector<uint8_t> state; // TC_ENTRY_* bits per entry
+        bool invalidated;
+        std::vector<Instruction> decoded;
+        std::vector<uint8_t> loadedImage;
+
+        void *mapping;
+        size_t mappingSize;
+};
+
+// 64-bit FNV-1a hash of a program image.
+uint64_t hashImage(const uint8_t *data, size_t length);
+
+// The per-user cache directory, or an empty string if $HOME is not set.
+std::string defaultTranslationCacheDir();
+
+#endif
@@ -0,0 +1,154 @@
+#include "UndoLog.h"
+#include "Simulator.h"
+
+#include <string.h>
+
+using namespace std;
+
+UndoLog::UndoLog(uint64_t capacityBytes, uint64_t checkpointInterval)
+    : head(0), tail(0), checkpointInterval(checkpointInterval < 1 ? 1 : checkpointInterval),
+      nextCheckpoint(0), barrier(0), barrierIndex(0) {
+    uint64_t chunkBytes = UNDO_CHUNK_RECORDS * sizeof(UndoRecord);
+    // one chunk more than the capacity, as the chunk being written is never full
+    chunks.resize(1 + (capacityBytes + chunkBytes - 1) / chunkBytes);
+    chunks[0].reset(new UndoRecord[UNDO_CHUNK_RECORDS]);
+}
+
+void UndoLog::advance() {
+    head++;
+    if (head % UNDO_CHUNK_RECORDS != 0) {
+        return;
+    }
+    unique_ptr<UndoRecord[]> &chunk = chunks[(head / UNDO_CHUNK_RECORDS) % chunks.size()];
+    if (!chunk) {
+        chunk.reset(new UndoRecord[UNDO_CHUNK_RECORDS]);
+    }
+    // the chunk about to be written may hold the oldest records
+    uint64_t kept = (chunks.size() - 1) * UNDO_CHUNK_RECORDS;
+    if (head - tail > kept) {
+        tail = head - kept;
+    }
+}
+
+void UndoLog::takeCheckpoint(uint64_t pc, const REGS &regs, MemoryStore *mem, uint64_t count) {
+    nextCheckpoint = (count / checkpointInterval + 1) * checkpointInterval;
+    // stepping back and running forward again passes the same points twice
+    while (!checkpoints.empty() && checkpoints.back().count >= count) {
+        checkpoints.pop_back();
+    }
+    // the first checkpoint stays, so any earlier state can still be re-executed to
+    if (checkpoints.size() == UNDO_MAX_CHECKPOINTS) {
+        checkpoints.erase(checkpoints.begin() + 1);
+    }
+
+    checkpoints.push_back(Checkpoint());
+    Checkpoint &cp = checkpoints.back();
+    cp.regs = regs;
+    cp.pc = pc;
+    cp.count = count;
+    cp.memory.resize(MEMORY_SIZE);
+    for (uint64_t addr = 0; addr < MEMORY_SIZE; addr += 8) {
+        uint64_t value = 0;
+        mem->getMemValue(addr, value, DOUBLE_SIZE);
+        memcpy(&cp.memory[addr], &value, 8);
+    }
+}
+
+void UndoLog::undoLast(Simulator &sim) {
+    head--;
+    const UndoRecord &r = at(head);
+    if (r.kind == UNDO_REG) {
+        sim.setReg(r.rd, r.oldValue);
+    }
+    else if (r.kind == UNDO_STORE) {
+        sim.writeMemory(r.address, r.oldValue, (MemEntrySize)r.size);
+    }
+    sim.rewind(r.pc, sim.getInstructionCount() - 1);
+}
+
+uint64_t UndoLog::stepBack(Simulator &sim, uint64_t n) {
+    uint64_t count = sim.getInstructionCount();
+    uint64_t target = n > count ? 0 : count - n;
+    if (target < barrier) {
+        target = barrier;
+    }
+    if (count - target <= size()) {
+        for (uint64_t i = target; i < count; i++) {
+            undoLast(sim);
+        }
+        return count - target;
+    }
+
+    // beyond the log: re-execute from the last checkpoint at or before target,
+    // and after the last ecall, so that no system call runs again
+    size_t c = checkpoints.size();
+    while (c > 0 && checkpoints[c - 1].count > target) {
+        c--;
+    }
+    if (c == 0 || checkpoints[c - 1].count < barrier) {
+        // none there: go back as far as state is kept
+        while (c < checkpoints.size() && checkpoints[c].count < barrier) {
+            c++;
+        }
+        if (c == checkpoints.size() || checkpoints[c].count >= count - size()) {
+            return backToStart(sim);
+        }
+        target = checkpoints[c].count;
+        c++;
+    }
+    Checkpoint &cp = checkpoints[c - 1];
+    for (unsigned r = 1; r < REG_SIZE; r++) {
+        sim.setReg(r, cp.regs.registers[r]);
+    }
+    for (uint64_t addr = 0; addr < MEMORY_SIZE; addr += 8) {
+        uint64_t current = 0, saved;
+        sim.readMemory(addr, current, DOUBLE_SIZE);
+        memcpy(&saved, &cp.memory[addr], 8);
+        if (current != saved) {
+            sim.writeMemory(addr, saved, DOUBLE_SIZE);
+        }
+    }
+    sim.rewind(cp.pc, cp.count);
+    tail = head;
+    nextCheckpoint = cp.count;
+    // breakpoints and watchpoints on the way are passed, as the first run of
+    // these instructions already stopped at them
+    SimStatus status = SIM_RUNNING;
+    while (sim.getInstructionCount() < target &&
+           (status == SIM_RUNNING || status == SIM_BREAKPOINT || status == SIM_WATCHPOINT)) {
+        status = sim.run(target - sim.getInstructionCount());
+    }
+    if (status == SIM_WATCHPOINT) {
+        sim.rewind(sim.getPC(), sim.getInstructionCount());
+    }
+    return count - sim.getInstructionCount();
+}
+
+bool UndoLog::backToLastWrite(Simulator &sim, uint64_t address, UndoRecord &store) {
+    for (uint64_t i = head; i-- > oldest(); ) {
+        const UndoRecord &r = at(i);
+        if (r.kind == UNDO_STORE && address >= r.address && address < r.address + r.size) {
+            store = r;
+            while (head > i) {
+                undoLast(sim);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t UndoLog::backToStart(Simulator &sim) {
+    uint64_t n = size();
+    while (head > oldest()) {
+        undoLast(sim);
+    }
+    return n;
+}
+
+void UndoLog::clear() {
+    tail = head;
+    checkpoints.clear();
+    nextCheckpoint = 0;
+    barrier = 0;
+}
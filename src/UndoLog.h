@@ -0,0 +1,141 @@
+#ifndef UNDO_LOG_H
+#define UNDO_LOG_H
+
+#include <memory>
+#include <vector>
+
+#include "sim.h"
+
+class Simulator;
+
+// records per arena chunk; the log grows and recycles a chunk at a time
+#define UNDO_CHUNK_RECORDS (1 << 16)
+// checkpoints kept for going back further than the log reaches, the first one and
+// the most recent ones
+#define UNDO_MAX_CHECKPOINTS 16
+
+enum UndoKind : uint8_t {
+    UNDO_PC = 0, // nothing to restore but the PC
+    UNDO_REG,    // rd held oldValue
+    UNDO_STORE   // size bytes at address held oldValue
+};
+
+// How to take back one executed instruction.
+struct UndoRecord {
+    uint32_t pc;       // executed instructions lie within MEMORY_SIZE
+    uint8_t  kind;     // UndoKind
+    uint8_t  rd;
+    uint8_t  size;
+    uint8_t  unused;
+    uint64_t oldValue;
+    uint64_t address;
+};
+
+// A bounded log for running a simulation backwards.
+//
+// Simulator::step records, before each instruction executes, what it is about to
+// overwrite: the old value of rd or the old bytes under a store. Records live in
+// fixed-size chunks allocated as the log grows; once the log is at its capacity
+// the oldest chunk is reused. A full checkpoint is also taken every so often, so
+// states older than the log can still be reached by restoring the checkpoint
+// before them and re-executing forward.
+//
+// System calls are not taken back: what they read from the host, the program
+// break and an exit live outside the registers and memory recorded here, and
+// running a read forward again would consume more input. Going back therefore
+// stops right after the last ecall; once the log no longer reaches back that
+// far, it stops at the first checkpoint taken after the call instead.
+class UndoLog
+{
+    public:
+        // capacityBytes bounds the records (rounded to whole chunks, at least one);
+        // a checkpoint is taken every checkpointInterval instructions.
+        UndoLog(uint64_t capacityBytes, uint64_t checkpointInterval);
+
+        // Called by Simulator::step before inst executes as instruction number count.
+        void record(const Instruction &inst, const REGS &regs, MemoryStore *mem, uint64_t count) {
+            if (count >= nextCheckpoint) {
+                takeCheckpoint(inst.PC, regs, mem, count);
+            }
+            if (inst.isEcall) {
+                // going back stops after the call
+                barrier = count + 1;
+                barrierIndex = head + 1;
+            }
+            UndoRecord &r = chunks[(head / UNDO_CHUNK_RECORDS) % chunks.size()][head % UNDO_CHUNK_RECORDS];
+            r.pc = inst.PC;
+            r.kind = UNDO_PC;
+            if (inst.writesMem) {
+                uint64_t address = regs.registers[inst.rs1] + inst.imm;
+                uint8_t size = 1 << (inst.funct3 & 3);
+                // a store out of range writes nothing and has nothing to restore
+                if (address + size <= MEMORY_SIZE && address + size > address) {
+                    r.kind = UNDO_STORE;
+                    r.size = size;
+                    r.address = address;
+                    r.oldValue = 0;
+                    mem->getMemValue(address, r.oldValue, (MemEntrySize)size);
+                }
+            }
+            else if (inst.writesRd && inst.rd != 0) {
+                r.kind = UNDO_REG;
+                r.rd = inst.rd;
+                r.oldValue = regs.registers[inst.rd];
+            }
+            advance();
+        }
+
+        // Instructions the log can take back without a checkpoint.
+        uint64_t size() const { return head - oldest(); }
+
+        // The record that taking back one instruction would apply, or NULL.
+        const UndoRecord *last() const { return head > oldest() ? &at(head - 1) : NULL; }
+
+        // Takes back the last n instructions executed on sim, from the log as far
+        // as it reaches and from a checkpoint beyond that. Returns how many were
+        // taken back, fewer than n only when no state is kept that far back or an
+        // ecall is in the way.
+        uint64_t stepBack(Simulator &sim, uint64_t n);
+
+        // The instruction count right after the last ecall, which going back
+        // stops at; 0 if there was none.
+        uint64_t getBarrier() const { return barrier; }
+
+        // Takes back instructions up to and including the last store to address,
+        // as far as the log reaches. Returns false, leaving sim unchanged, if there
+        // is no such store in the log.
+        bool backToLastWrite(Simulator &sim, uint64_t address, UndoRecord &store);
+
+        // Takes back every instruction the log holds.
+        uint64_t backToStart(Simulator &sim);
+
+        // Forgets everything; for when sim is reloaded or changed from outside.
+        void clear();
+
+    private:
+        struct Checkpoint {
+            REGS regs;
+            uint64_t pc;
+            uint64_t count;
+            std::vector<uint8_t> memory;
+        };
+
+        void advance();
+        void takeCheckpoint(uint64_t pc, const REGS &regs, MemoryStore *mem, uint64_t count);
+        const UndoRecord &at(uint64_t index) const {
+            return chunks[(index / UNDO_CHUNK_RECORDS) % chunks.size()][index % UNDO_CHUNK_RECORDS];
+        }
+        void undoLast(Simulator &sim);
+        uint64_t oldest() const { return tail > barrierIndex ? tail : barrierIndex; }
+
+        std::vector<std::unique_ptr<UndoRecord[]> > chunks; // allocated on first use
+        uint64_t head; // index of the next record
+        uint64_t tail; // index of the oldest record kept
+        uint64_t checkpointInterval;
+        uint64_t nextCheckpoint;
+        uint64_t barrier;      // instruction count right after the last ecall
+        uint64_t barrierIndex; // index of the record after the last ecall's
+        std::vector<Checkpoint> checkpoints; // oldest first
+};
+
+#endif
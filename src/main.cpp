@@ -0,0 +1,497 @@
+#include "Simulator.h"
+#include "SimServer.h"
+#include "Profiler.h"
+#include "AnalysisPipeline.h"
+#include "IntervalSimulation.h"
+#include "Debugger.h"
+#include "Devices.h"
+#include "Syscalls.h"
+#include "LiveStats.h"
+#include "Coverage.h"
+#include "Disassembler.h"
+#include "SymbolTable.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+// instructions simulated between returns to the driver loop, which checks the
+// limits below in between
+static const uint64_t RUN_SLICE = 1 << 20;
+
+// Exit codes of a program the driver loop stopped, after dumping its state.
+// 124 is what timeout(1) exits with.
+static const int EXIT_TIMEOUT = 124;
+static const int EXIT_BUDGET = 125;
+static const int EXIT_SPINNING = 126;
+
+// Why the driver loop stopped a program that was still running.
+enum RunLimit {
+    LIMIT_NONE = 0,
+    LIMIT_TIMEOUT,  // --timeout seconds passed
+    LIMIT_BUDGET,   // --max-insts instructions executed
+    LIMIT_SPINNING  // Simulator::findSpin found the program in an endless loop
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <instruction_file>\n", prog);
+    fprintf(stderr, "       %s --serve <socket> [--workers <n>]\n", prog);
+    fprintf(stderr, "       %s --disasm [--symbols <elf>] [--threads <n>] <instruction_file>\n", prog);
+    fprintf(stderr, "       %s --coverage-report <file>\n", prog);
+    fprintf(stderr, "  --no-translation-cache          fetch and decode every instruction\n");
+    fprintf(stderr, "  --translation-cache-dir <dir>   where predecoded programs are kept\n");
+    fprintf(stderr, "  --translation-cache-size <MiB>  evict least recently used beyond this\n");
+    fprintf(stderr, "  --profile                       count every instruction per PC and call stack\n");
+    fprintf(stderr, "  --profile-period <n>            sample about one instruction in n instead\n");
+    fprintf(stderr, "  --profile-out <file>            folded call stacks (default profile.folded)\n");
+    fprintf(stderr, "  --profile-top <n>               hottest instructions listed (default 20)\n");
+    fprintf(stderr, "  --symbols <elf>                 name functions in the profile and in --disasm\n");
+    fprintf(stderr, "  --analysis <name>[,<name>...]   run analyses on other cores (list: show them)\n");
+    fprintf(stderr, "  --dump-binary <file>            dump state in binary instead of text (see simdump)\n");
+    fprintf(stderr, "  --dump-every <n>                also append a delta dump every n instructions\n");
+    fprintf(stderr, "  --intervals <n>                 checkpoint every n instructions, then replay the\n");
+    fprintf(stderr, "                                  intervals with the analyses on all cores\n");
+    fprintf(stderr, "  --threads <n>                   cores used by --intervals and --disasm (default: all)\n");
+    fprintf(stderr, "  --scaling                       time --intervals on 1, 2, 4, ... threads\n");
+    fprintf(stderr, "  --devices                       map a UART at 0x%x and a timer at 0x%x\n", UART_BASE, TIMER_BASE);
+    fprintf(stderr, "  --uart-out <file>               --devices, with UART output to file instead of stdout\n");
+    fprintf(stderr, "  --max-insts <n>                 stop after n instructions (exit code %d)\n", EXIT_BUDGET);
+    fprintf(stderr, "  --timeout <seconds>             stop after this long (exit code %d)\n", EXIT_TIMEOUT);
+    fprintf(stderr, "  --no-spin-detect                keep running programs stuck in an endless loop\n");
+    fprintf(stderr, "                                  (which otherwise stop with exit code %d)\n", EXIT_SPINNING);
+    fprintf(stderr, "  --stats <file>                  publish live statistics to file for simtop\n");
+    fprintf(stderr, "  --coverage <file>               add the operations and operand classes executed to\n");
+    fprintf(stderr, "                                  file (see --coverage-report)\n");
+    fprintf(stderr, "  --debug                         step forwards and backwards with commands from stdin\n");
+    fprintf(stderr, "  --script <file>                 --debug, reading the commands from file\n");
+    fprintf(stderr, "  --undo-log <MiB>                undo records kept by --debug (default 64, 0: none)\n");
+    fprintf(stderr, "  --undo-checkpoint <n>           --debug checkpoints every n instructions (default 1M)\n");
+}
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// The two phases of --intervals: a functional run that records checkpoints, then
+// the analyses replayed interval by interval on threads cores (or on 1, 2, 4, ...
+// up to threads with scaling) and merged. Returns false if a replay diverged.
+static bool runIntervals(Simulator &sim, uint64_t interval, unsigned threads, bool scaling,
+                         const vector<string> &analyses, SimStatus &status) {
+    IntervalSimulation intervals(interval);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    status = intervals.record(sim);
+    printf("functional pass: %lu instructions in %zu intervals, %.3f s\n",
+           sim.getInstructionCount(), intervals.getIntervalCount(), secondsSince(start));
+
+    vector<unsigned> threadCounts;
+    for (unsigned t = 1; scaling && t < threads; t *= 2) {
+        threadCounts.push_back(t);
+    }
+    threadCounts.push_back(threads);
+
+    vector<unique_ptr<AnalysisPlugin> > merged;
+    double oneThread = 0;
+    for (size_t i = 0; i < threadCounts.size(); i++) {
+        string error;
+        start = chrono::steady_clock::now();
+        if (!intervals.replay(threadCounts[i], analyses, merged, error)) {
+            fprintf(stderr, "[ERROR] Interval replay diverged from the functional pass: %s\n", error.c_str());
+            return false;
+        }
+        double seconds = secondsSince(start);
+        if (threadCounts[i] == 1) {
+            oneThread = seconds;
+        }
+        printf("replay on %2u thread%s: %.3f s", threadCounts[i], threadCounts[i] == 1 ? " " : "s", seconds);
+        if (oneThread > 0 && threadCounts[i] > 1) {
+            printf(" (%.2fx)", oneThread / seconds);
+        }
+        printf("\n");
+    }
+    printf("every interval ended in the state the functional pass recorded\n");
+    for (size_t a = 0; a < analyses.size(); a++) {
+        printf("\n==== %s ====\n", analyses[a].c_str());
+        merged[a]->report(stdout);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+
+    char *programFile = NULL;
+    bool useTranslationCache = true;
+    string cacheDir = defaultTranslationCacheDir();
+    uint64_t cacheCap = TRANSLATION_CACHE_DEFAULT_CAP;
+    const char *serveSocket = NULL;
+    unsigned workers = thread::hardware_concurrency();
+    bool profile = false;
+    uint64_t profilePeriod = 1;
+    const char *profileOut = "profile.folded";
+    unsigned profileTop = 20;
+    const char *symbolFile = NULL;
+    vector<string> analyses;
+    const char *binaryDumpFile = NULL;
+    uint64_t dumpEvery = 0;
+    uint64_t interval = 0;
+    unsigned threads = thread::hardware_concurrency();
+    bool scaling = false;
+    bool disasm = false;
+    bool useDevices = false;
+    const char *uartFile = NULL;
+    const char *statsFile = NULL;
+    const char *coverageFile = NULL;
+    const char *coverageReport = NULL;
+    uint64_t maxInstructions = 0;
+    double timeout = 0;
+    bool spinDetect = true;
+    bool debug = false;
+    const char *scriptFile = NULL;
+    uint64_t undoLogSize = 64;
+    uint64_t undoCheckpoint = 1 << 20;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-translation-cache") == 0) {
+            useTranslationCache = false;
+        }
+        else if (strcmp(argv[i], "--translation-cache-dir") == 0 && i + 1 < argc) {
+            cacheDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--translation-cache-size") == 0 && i + 1 < argc) {
+            cacheCap = strtoull(argv[++i], NULL, 0) << 20;
+        }
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serveSocket = argv[++i];
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--profile") == 0) {
+            profile = true;
+        }
+        else if (strcmp(argv[i], "--profile-period") == 0 && i + 1 < argc) {
+            profile = true;
+            profilePeriod = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--profile-out") == 0 && i + 1 < argc) {
+            profileOut = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile-top") == 0 && i + 1 < argc) {
+            profileTop = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--symbols") == 0 && i + 1 < argc) {
+            symbolFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--analysis") == 0 && i + 1 < argc) {
+            string names = argv[++i];
+            if (names == "list") {
+                printAnalyses(stdout);
+                return 0;
+            }
+            for (size_t start = 0; start <= names.size(); ) {
+                size_t end = names.find(',', start);
+                string name = names.substr(start, end == string::npos ? string::npos : end - start);
+                unique_ptr<AnalysisPlugin> plugin(createAnalysis(name));
+                if (plugin == NULL) {
+                    fprintf(stderr, "Unknown analysis '%s'; available:\n", name.c_str());
+                    printAnalyses(stderr);
+                    return -1;
+                }
+                analyses.push_back(name);
+                start = end == string::npos ? names.size() + 1 : end + 1;
+            }
+        }
+        else if (strcmp(argv[i], "--dump-binary") == 0 && i + 1 < argc) {
+            binaryDumpFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--dump-every") == 0 && i + 1 < argc) {
+            dumpEvery = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--intervals") == 0 && i + 1 < argc) {
+            interval = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--scaling") == 0) {
+            scaling = true;
+        }
+        else if (strcmp(argv[i], "--disasm") == 0) {
+            disasm = true;
+        }
+        else if (strcmp(argv[i], "--devices") == 0) {
+            useDevices = true;
+        }
+        else if (strcmp(argv[i], "--uart-out") == 0 && i + 1 < argc) {
+            useDevices = true;
+            uartFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--max-insts") == 0 && i + 1 < argc) {
+            maxInstructions = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            timeout = strtod(argv[++i], NULL);
+        }
+        else if (strcmp(argv[i], "--no-spin-detect") == 0) {
+            spinDetect = false;
+        }
+        else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            statsFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--coverage") == 0 && i + 1 < argc) {
+            coverageFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--coverage-report") == 0 && i + 1 < argc) {
+            coverageReport = argv[++i];
+        }
+        else if (strcmp(argv[i], "--debug") == 0) {
+            debug = true;
+        }
+        else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+            debug = true;
+            scriptFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--undo-log") == 0 && i + 1 < argc) {
+            undoLogSize = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--undo-checkpoint") == 0 && i + 1 < argc) {
+            undoCheckpoint = strtoull(argv[++i], NULL, 0);
+        }
+        else if (argv[i][0] != '-' && programFile == NULL) {
+            programFile = argv[i];
+        }
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (serveSocket != NULL) {
+        return runSimServer(serveSocket, workers);
+    }
+    if (coverageReport != NULL) {
+        Coverage coverage;
+        if (!coverage.load(coverageReport)) {
+            return -1;
+        }
+        coverage.report(stdout);
+        return 0;
+    }
+    if (programFile == NULL) {
+        usage(argv[0]);
+        return -1;
+    }
+    if (interval > 0 && dumpEvery > 0) {
+        fprintf(stderr, "--intervals cannot be combined with --dump-every\n");
+        return -1;
+    }
+    if (useDevices && (interval > 0 || debug)) {
+        // reverse execution does not take back device accesses or events
+        fprintf(stderr, "--devices cannot be combined with --intervals or --debug\n");
+        return -1;
+    }
+    if (debug && (interval > 0 || dumpEvery > 0)) {
+        fprintf(stderr, "--debug cannot be combined with --intervals or --dump-every\n");
+        return -1;
+    }
+    if ((maxInstructions > 0 || timeout > 0) && (interval > 0 || debug)) {
+        fprintf(stderr, "--max-insts and --timeout cannot be combined with --intervals or --debug\n");
+        return -1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    if (disasm) {
+        vector<uint8_t> image;
+        SymbolTable symbols;
+        if (!loadProgramImage(programFile, image) || (symbolFile != NULL && !symbols.loadElf(symbolFile))) {
+            return -1;
+        }
+        return disassembleImage(image, stdout, threads, symbolFile != NULL ? &symbols : NULL) ? 0 : -1;
+    }
+
+    // initialize memory store with buffer contents
+    Simulator sim;
+    sim.setTranslationCache(useTranslationCache, cacheDir, cacheCap);
+    if (!sim.load(programFile)) {
+        fprintf(stderr, "Failed to initialize memory with program binary.\n");
+        return -1;
+    }
+
+    // guest output, from system calls and the UART alike; stdin carries the
+    // commands of an interactive --debug
+    HostOutput guestOut(STDOUT_FILENO);
+    HostOutput guestErr(STDERR_FILENO);
+    SyscallEmulator syscalls(guestOut, guestErr, debug && scriptFile == NULL ? -1 : STDIN_FILENO);
+    sim.setSyscalls(&syscalls);
+
+    unique_ptr<HostOutput> uartFileOut;
+    if (uartFile != NULL) {
+        int fd = open(uartFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            perror(uartFile);
+            return -1;
+        }
+        uartFileOut.reset(new HostOutput(fd));
+    }
+    DeviceBus devices;
+    Uart uart(devices, uartFileOut ? *uartFileOut : guestOut);
+    Timer timer(devices);
+    if (useDevices) {
+        devices.map(UART_BASE, UART_SIZE, &uart);
+        devices.map(TIMER_BASE, TIMER_SIZE, &timer);
+        sim.setDevices(&devices);
+    }
+
+    Profiler profiler(profilePeriod);
+    if (profile) {
+        if (symbolFile != NULL && !profiler.getSymbols().loadElf(symbolFile)) {
+            return -1;
+        }
+        sim.setProfiler(&profiler);
+    }
+    AnalysisPipeline analysis;
+    if (interval == 0 && !analyses.empty()) {
+        for (size_t a = 0; a < analyses.size(); a++) {
+            analysis.add(analyses[a], createAnalysis(analyses[a]));
+        }
+        sim.setAnalysis(&analysis);
+    }
+
+    LiveStats stats;
+    if (statsFile != NULL) {
+        if (!stats.open(statsFile, programFile)) {
+            return -1;
+        }
+        sim.setLiveStats(&stats);
+    }
+    Coverage coverage;
+    if (coverageFile != NULL) {
+        sim.setCoverage(&coverage);
+    }
+
+    FILE *binaryDump = NULL;
+    if (binaryDumpFile != NULL) {
+        binaryDump = fopen(binaryDumpFile, "wb");
+        if (binaryDump == NULL) {
+            perror(binaryDumpFile);
+            return -1;
+        }
+        if (dumpEvery > 0 && !sim.dumpBinary(binaryDump, DUMP_FULL)) {
+            return -1;
+        }
+    }
+
+    // start simulation
+    SimStatus status;
+    RunLimit limit = LIMIT_NONE;
+    bool periodicDumps = dumpEvery > 0 && binaryDump != NULL;
+    if (interval > 0) {
+        if (!runIntervals(sim, interval, threads, scaling, analyses, status)) {
+            return -1;
+        }
+    }
+    else if (debug) {
+        unique_ptr<UndoLog> undoLog;
+        if (undoLogSize > 0) {
+            undoLog.reset(new UndoLog(undoLogSize << 20, undoCheckpoint));
+        }
+        FILE *commands = scriptFile != NULL ? fopen(scriptFile, "r") : stdin;
+        if (commands == NULL) {
+            perror(scriptFile);
+            return -1;
+        }
+        status = Debugger(sim, undoLog.get()).run(commands);
+        if (commands != stdin) {
+            fclose(commands);
+        }
+        sim.setUndoLog(NULL);
+    }
+    else {
+        // the limits are checked between slices, never per instruction
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        uint64_t budget = maxInstructions > 0 ? maxInstructions : UINT64_MAX;
+        uint64_t nextSpinCheck = RUN_SLICE;
+        do {
+            uint64_t left = budget - sim.getInstructionCount();
+            status = sim.run(min(periodicDumps ? dumpEvery : RUN_SLICE, left));
+            if (status == SIM_RUNNING && periodicDumps && !sim.dumpBinary(binaryDump, DUMP_DELTA)) {
+                return -1;
+            }
+            if (status != SIM_RUNNING) {
+                break;
+            }
+            if (sim.getInstructionCount() >= budget) {
+                limit = LIMIT_BUDGET;
+            }
+            else if (timeout > 0 && secondsSince(start) >= timeout) {
+                limit = LIMIT_TIMEOUT;
+            }
+            else if (spinDetect && sim.getInstructionCount() >= nextSpinCheck) {
+                nextSpinCheck = sim.getInstructionCount() + RUN_SLICE;
+                if (sim.findSpin(min((uint64_t)SPIN_WINDOW, budget - sim.getInstructionCount()))) {
+                    limit = LIMIT_SPINNING;
+                }
+                status = sim.getStatus();
+            }
+        } while (status == SIM_RUNNING && limit == LIMIT_NONE);
+    }
+
+    if (statsFile != NULL) {
+        stats.finish(sim);
+    }
+    if (coverageFile != NULL && !coverage.mergeInto(coverageFile)) {
+        return -1;
+    }
+
+    // guest output goes out ahead of the reports
+    guestOut.flush();
+    guestErr.flush();
+    devices.flush();
+    if (profile) {
+        profiler.printTop(stdout, profileTop, sim.getMemory());
+        profiler.writeFolded(profileOut);
+    }
+    if (!analysis.empty()) {
+        analysis.report(stdout);
+    }
+
+    if (status == SIM_ILLEGAL) {
+        fprintf(stderr, "Illegal instruction encountered at PC: 0x%lx\n", sim.getPC());
+    }
+    else if (limit == LIMIT_BUDGET) {
+        fprintf(stderr, "Stopped after %lu instructions at PC: 0x%lx\n", sim.getInstructionCount(), sim.getPC());
+    }
+    else if (limit == LIMIT_TIMEOUT) {
+        fprintf(stderr, "Timed out after %lu instructions at PC: 0x%lx\n", sim.getInstructionCount(), sim.getPC());
+    }
+    else if (limit == LIMIT_SPINNING) {
+        fprintf(stderr, "Endless loop at PC: 0x%lx, stopped after %lu instructions\n",
+                sim.getPC(), sim.getInstructionCount());
+    }
+    if (binaryDump != NULL) {
+        bool written = sim.dumpBinary(binaryDump, periodicDumps ? DUMP_DELTA : DUMP_FULL);
+        if (fclose(binaryDump) != 0 || !written) {
+            return -1;
+        }
+    }
+    else {
+        sim.dump();
+    }
+    if (syscalls.hasExited()) {
+        return syscalls.getExitCode();
+    }
+    switch (limit) {
+        case LIMIT_TIMEOUT:  return EXIT_TIMEOUT;
+        case LIMIT_BUDGET:   return EXIT_BUDGET;
+        case LIMIT_SPINNING: return EXIT_SPINNING;
+        case LIMIT_NONE:     break;
+    }
+    // exit with error on an illegal instruction
+    return status == SIM_ILLEGAL ? 127 : 0;
+}
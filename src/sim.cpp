@@ -1,9 +1,12 @@
 #include "sim.h"
+#include "StateDump.h"
+#include "Coverage.h"
 
 using namespace std;
 
 
-// RV64I without csr, environment, or fence instructions
+// RV64IMC without csr or fence instructions; ecall is the only environment call.
+// Compressed instructions are expanded on fetch (see Compressed.cpp).
 
 //           31          25 24 20 19 15 14    12 11          7 6      0
 // R  type: | funct7       | rs2 | rs1 | funct3 | rd          | opcode |
@@ -15,12 +18,12 @@ using namespace std;
 
 
 // printing toggle mode
-static const bool DEBUG_MODE = true;  
+static const bool DEBUG_MODE = false;
 
 
 
-// initialize memory with program binary
-bool initMemory(char *programFile, MemoryStore *myMem) {
+// read the program binary into image
+bool loadProgramImage(const char *programFile, vector<uint8_t> &image) {
     // open instruction file
     ifstream infile;
     infile.open(programFile, ios::binary | ios::in);
@@ -35,24 +38,35 @@ bool initMemory(char *programFile, MemoryStore *myMem) {
     int length = infile.tellg();
     infile.seekg (0, ios::beg);
 
-    char *buf = new char[length];
-    infile.read(buf, length);
+    image.resize(length);
+    infile.read((char *)image.data(), length);
     infile.close();
 
-    int memLength = length / sizeof(buf[0]);
-    int i;
-    for (i = 0; i < memLength; i++) {
-        myMem->setMemValue(i * BYTE_SIZE, buf[i], BYTE_SIZE);
+    return true;
+}
+
+// copy a loaded program image into memory
+void initMemory(const vector<uint8_t> &image, MemoryStore *myMem) {
+    for (size_t i = 0; i < image.size(); i++) {
+        myMem->setMemValue(i * BYTE_SIZE, image[i], BYTE_SIZE);
     }
+}
 
+// initialize memory with program binary
+bool initMemory(char *programFile, MemoryStore *myMem) {
+    vector<uint8_t> image;
+    if (!loadProgramImage(programFile, image)) {
+        return false;
+    }
+    initMemory(image, myMem);
     return true;
 }
 
 // dump registers and memory
-void dump(MemoryStore *myMem) {
+void dump(REGS &regData, MemoryStore *myMem) {
 
-    dumpRegisterState(regData.reg);
-    dumpMemoryState(myMem);
+    // dumpMemoryState only understands the stock MemoryStore implementation
+    writeStateFiles(regData.reg, myMem);
 }
 
 // TODO All functions below (except main) are incomplete.
@@ -65,16 +79,30 @@ int64_t signExtend(uint64_t x, int bits) {
 
 // Get raw instruction bits from memory
 Instruction simFetch(uint64_t PC, MemoryStore *myMem) {
-    // fetch current instruction
-    uint64_t instruction;
-    myMem->getMemValue(PC, instruction, WORD_SIZE);
-    instruction = (uint32_t)instruction;
+    // fetch current instruction; a compressed one in the last parcel of memory
+    // has nothing after it. Outside memory the read fails and fetches zero, which
+    // is illegal.
+    uint64_t instruction = 0;
+    myMem->getMemValue(PC, instruction, PC + WORD_SIZE > MEMORY_SIZE && PC < MEMORY_SIZE ? HALF_SIZE : WORD_SIZE);
 
-    printf("Fetched instruction 0x%08lx at PC=0x%lx\n", instruction, PC);
+    if (DEBUG_MODE) {
+        printf("Fetched instruction 0x%08lx at PC=0x%lx\n", instruction, PC);
+    }
 
+    return simFetchWord(PC, (uint32_t)instruction);
+}
+
+Instruction simFetchWord(uint64_t PC, uint32_t word) {
     Instruction inst;
     inst.PC = PC;
-    inst.instruction = instruction;
+    // the halt word comes first: its low half would read as a compressed c.bnez
+    if ((word & 0b11) != 0b11 && word != 0xfeedfeed) {
+        inst.instruction = expandCompressed(word & 0xffff);
+        inst.length = 2;
+    }
+    else {
+        inst.instruction = word;
+    }
     return inst;
 }
 
@@ -84,10 +112,12 @@ Instruction simDecode(Instruction inst) {
     
     if (inst.instruction == 0xfeedfeed) {
         inst.isHalt = true;
+        inst.coverage = coveragePoint(inst);
         return inst; // halt instruction
     }
     if (inst.instruction == 0x00000013) { // addi 
         inst.isNop = true;
+        inst.coverage = coveragePoint(inst);
         return inst; // NOP instruction
     }
     inst.isLegal = true; // assume legal unless proven otherwise
@@ -115,10 +145,10 @@ Instruction simDecode(Instruction inst) {
 
                 // I-type shift-immediates (RV64 -> 6-bit shamt)
                 if (inst.funct3 == FUNCT3_SLL) {
-                    immHi  = (inst.instruction >> 25) & 0x7F; // imm[11:5]
+                    immHi  = (inst.instruction >> 25) & 0x7E; // imm[11:6]; imm[5] is shamt[5]
                     shamt6 = (inst.instruction >> 20) & 0x3F; // 6-bit shamt
 
-                    // SLLI: imm[11:5] must be 0000000; shamt in [0..63]
+                    // SLLI: imm[11:6] must be 000000; shamt in [0..63]
                     if (immHi != 0b0000000) {
                     inst.isLegal = false;
                     }
@@ -128,10 +158,10 @@ Instruction simDecode(Instruction inst) {
                     }
                 } 
                 else if (inst.funct3 == FUNCT3_SRL_SRA) {
-                    immHi  = (inst.instruction >> 25) & 0x7F; // imm[11:5]
+                    immHi  = (inst.instruction >> 25) & 0x7E; // imm[11:6]; imm[5] is shamt[5]
                     shamt6 = (inst.instruction >> 20) & 0x3F;
 
-                    // SRLI (0000000) or SRAI (0100000) only; shamt in [0..63]
+                    // SRLI (000000) or SRAI (010000) only; shamt in [0..63]
                     if (!(immHi == 0b0000000 || immHi == 0b0100000)) {
                     inst.isLegal = false;
                     }
@@ -209,13 +239,16 @@ Instruction simDecode(Instruction inst) {
             }
             break; 
 
-        case OP_RTYPE: //add, sub, sll, slt, sltu, xor, srl, sra, or, and
+        case OP_RTYPE: //add, sub, sll, slt, sltu, xor, srl, sra, or, and; mul, mulh, mulhsu, mulhu, div, divu, rem, remu
             inst.doesArithLogic = true;
             inst.writesRd = true;
             inst.readsRs1 = true;
             inst.readsRs2 = true;
 
-            if (inst.funct3 == FUNCT3_ADD_SUB || 
+            if (inst.funct7 == FUNCT7_MULDIV) {
+                // RV64M: every funct3 is a multiply or divide
+            }
+            else if (inst.funct3 == FUNCT3_ADD_SUB || 
                 inst.funct3 == FUNCT3_SLL || 
                 inst.funct3 == FUNCT3_SLT || 
                 inst.funct3 == FUNCT3_SLTU ||
@@ -240,13 +273,23 @@ Instruction simDecode(Instruction inst) {
             }
             break;
 
-        case OP_RTYPEW: //addw, subw, sllw, srlw, sraw
+        case OP_RTYPEW: //addw, subw, sllw, srlw, sraw; mulw, divw, divuw, remw, remuw
             inst.doesArithLogic = true;
             inst.writesRd = true;
             inst.readsRs1 = true;
             inst.readsRs2 = true;
 
-            if (inst.funct3 == FUNCT3_ADD_SUB || 
+            if (inst.funct7 == FUNCT7_MULDIV) {
+                // RV64M W forms: no high-half multiplies
+                if (!(inst.funct3 == FUNCT3_MUL || 
+                      inst.funct3 == FUNCT3_DIV || 
+                      inst.funct3 == FUNCT3_DIVU || 
+                      inst.funct3 == FUNCT3_REM || 
+                      inst.funct3 == FUNCT3_REMU)) {
+                    inst.isLegal = false;
+                }
+            }
+            else if (inst.funct3 == FUNCT3_ADD_SUB || 
                 inst.funct3 == FUNCT3_SLL || 
                 inst.funct3 == FUNCT3_SRL_SRA ) {
 
@@ -337,9 +380,22 @@ Instruction simDecode(Instruction inst) {
             }
             break;
 
+        case OP_SYSTEM:
+            // ecall; ebreak and the CSR instructions are not supported
+            if (inst.instruction == 0x00000073) {
+                inst.isEcall = true;
+                inst.writesRd = true;
+                inst.rd = 10; // a0
+            }
+            else {
+                inst.isLegal = false;
+            }
+            break;
+
         default:
             inst.isLegal = false;
     }
+    inst.coverage = coveragePoint(inst);
     return inst;
 }
 
@@ -393,6 +449,14 @@ Instruction instructionTypeandBits(Instruction inst) {
         inst.imm = inst.instruction >> 20 & 0b111111111111;
         uint64_t imm12 = (inst.instruction >> 20) & 0xFFF;
         inst.imm = signExtend(imm12, 12);
+
+        // shift-immediates carry funct7 in imm[11:5]; in RV64 imm[5] is shamt[5]
+        if (inst.opcode == OP_INTIMM) {
+            inst.funct7 = (inst.instruction >> 25) & 0b1111110;
+        }
+        else if (inst.opcode == OP_INTIMMW) {
+            inst.funct7 = (inst.instruction >> 25) & 0b1111111;
+        }
     }
     else if (inst.opcode == OP_STORE) {
         inst.isS = true;
@@ -420,7 +484,7 @@ Instruction instructionTypeandBits(Instruction inst) {
         inst.isU = true;
 
         inst.rd  = (inst.instruction >> 7)  & 0b11111;
-        inst.imm = (inst.instruction & 0xFFFFF000);
+        inst.imm = signExtend(inst.instruction & 0xFFFFF000, 32);
     }
     else if (inst.opcode == OP_JAL) {
         inst.isUJ = true;
@@ -456,7 +520,7 @@ Instruction instructionTypeandBits(Instruction inst) {
     return inst; 
 }
 
-// Resolve next PC whether +4 or branch/jump target
+// Resolve next PC whether the next instruction or branch/jump target
 Instruction simNextPCResolution(Instruction inst) {
 
     if (inst.isSB) {
@@ -469,25 +533,98 @@ Instruction simNextPCResolution(Instruction inst) {
             case FUNCT3_BLTU: takeBranch = (inst.op1Val < inst.op2Val); break;
             case FUNCT3_BGEU: takeBranch = (inst.op1Val >= inst.op2Val); break;
         }
-        inst.nextPC = takeBranch ? inst.PC + inst.imm : inst.PC + 4;
+        inst.nextPC = takeBranch ? inst.PC + inst.imm : inst.PC + inst.length;
     }
 
     else if (inst.opcode == OP_JAL) {
-        inst.arithResult = inst.PC + 4;
+        inst.arithResult = inst.PC + inst.length;
         inst.nextPC = inst.PC + inst.imm;
     }
 
     else if (inst.opcode == OP_JALR){
-        inst.arithResult = inst.PC + 4;
+        inst.arithResult = inst.PC + inst.length;
         inst.nextPC = (inst.op1Val + inst.imm) & ~1ULL;
     }
     else {
-        inst.nextPC = inst.PC + 4;
+        inst.nextPC = inst.PC + inst.length;
     }
 
     return inst;
 }
 
+// 128-bit products for the high-half multiplies, one host multiply each.
+// __extension__ keeps -Wpedantic quiet about the GCC/Clang type.
+__extension__ typedef __int128 int128;
+__extension__ typedef unsigned __int128 uint128;
+
+// RV64M on 64-bit operands. Division by zero and the one overflowing division
+// (most negative / -1) do not trap but have results fixed by the spec, which the
+// host divide instruction would trap on, so they are checked first.
+static uint64_t mulDiv64(uint64_t funct3, uint64_t a, uint64_t b) {
+    switch (funct3) {
+        case FUNCT3_MUL:
+            return a * b;
+        case FUNCT3_MULH:
+            return (uint64_t)(((int128)(int64_t)a * (int128)(int64_t)b) >> 64);
+        case FUNCT3_MULHSU:
+            return (uint64_t)(((int128)(int64_t)a * (int128)b) >> 64);
+        case FUNCT3_MULHU:
+            return (uint64_t)(((uint128)a * b) >> 64);
+        case FUNCT3_DIV:
+            if (b == 0) {
+                return ~0ULL;
+            }
+            if ((int64_t)b == -1) {
+                return 0 - a; // INT64_MIN / -1 wraps to INT64_MIN
+            }
+            return (uint64_t)((int64_t)a / (int64_t)b);
+        case FUNCT3_DIVU:
+            return b == 0 ? ~0ULL : a / b;
+        case FUNCT3_REM:
+            if (b == 0) {
+                return a;
+            }
+            if ((int64_t)b == -1) {
+                return 0;
+            }
+            return (uint64_t)((int64_t)a % (int64_t)b);
+        case FUNCT3_REMU:
+            return b == 0 ? a : a % b;
+    }
+    return 0;
+}
+
+// The W forms: low 32 bits of the operands, 32-bit result sign extended.
+static uint64_t mulDiv32(uint64_t funct3, uint64_t a64, uint64_t b64) {
+    int32_t a = (int32_t)a64;
+    int32_t b = (int32_t)b64;
+    switch (funct3) {
+        case FUNCT3_MUL:
+            return (int64_t)(int32_t)((uint32_t)a * (uint32_t)b);
+        case FUNCT3_DIV:
+            if (b == 0) {
+                return ~0ULL;
+            }
+            if (b == -1) {
+                return (int64_t)(int32_t)(0 - (uint32_t)a); // INT32_MIN / -1 wraps to INT32_MIN
+            }
+            return (int64_t)(a / b);
+        case FUNCT3_DIVU:
+            return b == 0 ? ~0ULL : (int64_t)(int32_t)((uint32_t)a / (uint32_t)b);
+        case FUNCT3_REM:
+            if (b == 0) {
+                return (int64_t)a;
+            }
+            if (b == -1) {
+                return 0;
+            }
+            return (int64_t)(a % b);
+        case FUNCT3_REMU:
+            return b == 0 ? (int64_t)a : (int64_t)(int32_t)((uint32_t)a % (uint32_t)b);
+    }
+    return 0;
+}
+
 // Perform arithmetic/logic operations
 Instruction simArithLogic(Instruction inst) {
     switch (inst.opcode) {
@@ -534,11 +671,11 @@ Instruction simArithLogic(Instruction inst) {
         case OP_INTIMMW:
             switch (inst.funct3) {
                 case FUNCT3_ADD_SUB: //addiw
-                    inst.arithResult = (u_int32_t)(inst.op1Val + inst.imm);
+                    inst.arithResult = (int64_t)(int32_t)(inst.op1Val + inst.imm);
                     
                     break;
                 case FUNCT3_SLL: //slliw
-                    inst.arithResult = (u_int32_t)(inst.op1Val << (inst.imm & 0b111111));
+                    inst.arithResult = (int64_t)(int32_t)(inst.op1Val << (inst.imm & 0x1F));
 
                     break;
                 case FUNCT3_SRL_SRA: 
@@ -558,6 +695,10 @@ Instruction simArithLogic(Instruction inst) {
         // -------- R-TYPE --------
         // Register to Register instructions add, sub, sll, slt, sltu, xor, srl, sra, or, and
         case OP_RTYPE:
+            if (inst.funct7 == FUNCT7_MULDIV) {
+                inst.arithResult = mulDiv64(inst.funct3, inst.op1Val, inst.op2Val);
+                break;
+            }
             switch (inst.funct3) {
                 case FUNCT3_ADD_SUB: 
                     // further check funct7 (ADD vs SUB)
@@ -604,6 +745,10 @@ Instruction simArithLogic(Instruction inst) {
         // -------- R-TYPE W (32-bit ops) --------
         // Register to Register instructions (keep low 32-bits and sign extends) addw, subw, sllw, srlw, sraw
         case OP_RTYPEW:
+            if (inst.funct7 == FUNCT7_MULDIV) {
+                inst.arithResult = mulDiv32(inst.funct3, inst.op1Val, inst.op2Val);
+                break;
+            }
             switch (inst.funct3) {
                 case FUNCT3_ADD_SUB: 
                     // further check funct7 (ADDW vs SUBW)
@@ -759,16 +904,14 @@ Instruction simCommit(Instruction inst, REGS &regData) {
     return inst;
 }
 
-// Simulate the whole instruction using functions above
-Instruction simInstruction(uint64_t &PC, MemoryStore *myMem, REGS &regData) {
-    Instruction inst = simFetch(PC, myMem);
-    inst = simDecode(inst);
+// Run a fetched and decoded instruction through the remaining stages
+Instruction simExecute(Instruction inst, uint64_t &PC, MemoryStore *myMem, REGS &regData) {
     if (inst.isHalt) {
         return inst;
     }
     
     if (inst.isNop) {
-        inst.nextPC = inst.PC + 4;
+        inst.nextPC = inst.PC + inst.length;
         PC = inst.nextPC;
         return inst;
     }
@@ -776,6 +919,13 @@ Instruction simInstruction(uint64_t &PC, MemoryStore *myMem, REGS &regData) {
     if (!inst.isLegal) {
         return inst;
     }
+
+    // the system call itself is up to the caller, which knows the host
+    if (inst.isEcall) {
+        inst.nextPC = inst.PC + inst.length;
+        PC = inst.nextPC;
+        return inst;
+    }
     inst = simOperandCollection(inst, regData);
     inst = simNextPCResolution(inst);
     inst = simArithLogic(inst);
@@ -786,44 +936,9 @@ Instruction simInstruction(uint64_t &PC, MemoryStore *myMem, REGS &regData) {
     return inst;
 }
 
-int main(int argc, char** argv) {
-
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <instruction_file>\n", argv[0]);
-        return -1;
-    }
-
-    // initialize memory store with buffer contents
-    MemoryStore *myMem = createMemoryStore();
-    if (!initMemory(argv[1], myMem)) {
-        fprintf(stderr, "Failed to initialize memory with program binary.\n");
-        return -1;
-    }
-
-    // initialize registers and program counter
-    regData.reg = {};
-    PC = 0;
-    bool err = false;
-    
-    // start simulation
-    while (!err) {
-        Instruction inst = simInstruction(PC, myMem, regData);
-        if (inst.isHalt) {
-            // Normal dump and exit
-            dump(myMem);
-            return 0;
-        }
-        if (!inst.isLegal) {
-            fprintf(stderr, "Illegal instruction encountered at PC: 0x%lx\n", inst.PC);
-            err = true;
-        }
-    }
-
-    // dump and exit with error
-    dump(myMem);
-    exit(127);
-    return -1;
+// Simulate the whole instruction using functions above
+Instruction simInstruction(uint64_t &PC, MemoryStore *myMem, REGS &regData) {
+    Instruction inst = simFetch(PC, myMem);
+    inst = simDecode(inst);
+    return simExecute(inst, PC, myMem, regData);
 }
-
-
-
@@ -1,8 +1,12 @@
+#ifndef SIM_H
+#define SIM_H
+
 #include <stdio.h>
 #include <assert.h>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "MemoryStore.h"
 #include "RegisterInfo.h"
@@ -16,10 +20,6 @@ union REGS {
     uint64_t registers[REG_SIZE] {0};
 };
 
-union REGS regData;
-
-uint64_t PC;
-
 // --------------------------------------------------------------------------
 // Decode constants
 // --------------------------------------------------------------------------
@@ -33,8 +33,8 @@ enum OPCODES {
     OP_LOAD = 0b0000011, // lb, lh, lw, ld, lbu, lhu, lwu
 
     // R-Type opcodes
-    OP_RTYPE = 0b0110011, // Register to Register instructions add, sub, sll, slt, sltu, xor, srl, sra, or, and
-    OP_RTYPEW = 0b0111011, // Register to Register instructions (keep low 32-bits and sign extends) addw, subw, sllw, srlw, sraw
+    OP_RTYPE = 0b0110011, // Register to Register instructions add, sub, sll, slt, sltu, xor, srl, sra, or, and; mul, mulh, mulhsu, mulhu, div, divu, rem, remu
+    OP_RTYPEW = 0b0111011, // Register to Register instructions (keep low 32-bits and sign extends) addw, subw, sllw, srlw, sraw; mulw, divw, divuw, remw, remuw
 
     // S-TYPE opcodes 
     OP_STORE = 0b0100011, // sb, sh, sw, sd
@@ -48,7 +48,10 @@ enum OPCODES {
 
     // Jump type instruction opcode
     OP_JALR = 0b1100111, // jalr I
-    OP_JAL = 0b1101111 //jal UJ
+    OP_JAL = 0b1101111, //jal UJ
+
+    // System opcode; only ecall, whose call the simulator performs (see Syscalls.h)
+    OP_SYSTEM = 0b1110011
 };
 
 enum FUNCT3 {
@@ -95,6 +98,18 @@ enum FUNCT3 {
     // R: AND
     // I: ANDI
 
+    // -----------------------------------------
+    // MULTIPLY/DIVIDE (RV64M, funct7 = 0000001)
+    // -----------------------------------------
+    FUNCT3_MUL            = 0b000, // MUL, MULW
+    FUNCT3_MULH           = 0b001, // MULH
+    FUNCT3_MULHSU         = 0b010, // MULHSU
+    FUNCT3_MULHU          = 0b011, // MULHU
+    FUNCT3_DIV            = 0b100, // DIV, DIVW
+    FUNCT3_DIVU           = 0b101, // DIVU, DIVUW
+    FUNCT3_REM            = 0b110, // REM, REMW
+    FUNCT3_REMU           = 0b111, // REMU, REMUW
+
     // -----
     // LOADS
     // -----
@@ -134,6 +149,7 @@ enum FUNCT3 {
 enum RI_FUNCT7 { 
     FUNCT7_DEFAULT= 0b0000000, // slli, srli, slliw, srliw, add, sll, slt, sltu, xor, srl, or, and, addw, sllw, srlw
     FUNCT7_SUB_SRA = 0b0100000, // funcs with distint funct7 code sub, srai, sraiw, sra, subw, sraw
+    FUNCT7_MULDIV  = 0b0000001, // RV64M: mul, mulh, mulhsu, mulhu, div, divu, rem, remu and the W forms
 };
 
 // --------------------------------------------------------------------------
@@ -150,8 +166,14 @@ enum RI_FUNCT7 {
 // initialize memory with program binary
 bool initMemory(char *programFile, MemoryStore *myMem);
 
+// read the program binary into image
+bool loadProgramImage(const char *programFile, std::vector<uint8_t> &image);
+
+// copy a loaded program image into memory
+void initMemory(const std::vector<uint8_t> &image, MemoryStore *myMem);
+
 // dump registers and memory
-void dump(MemoryStore *myMem);
+void dump(REGS &regData, MemoryStore *myMem);
 
 // added: sign extends 
 int64_t signExtend(uint64_t x, int bits);
@@ -164,11 +186,13 @@ int64_t signExtend(uint64_t x, int bits);
 // RISC-V instructions. Feel free to add more fields if needed.
 struct Instruction {
     uint64_t PC = 0;
-    uint64_t instruction = 0; // raw instruction binary
+    uint64_t instruction = 0; // raw instruction binary; for a compressed one, its 32-bit equivalent
+    uint64_t length = 4;      // bytes fetched: 2 for a compressed instruction
 
     bool     isHalt = false;
     bool     isLegal = false;
     bool     isNop = false;
+    bool     isEcall = false; // writes a0 with the system call's result
 
     bool     readsMem = false;
     bool     writesMem = false;
@@ -200,6 +224,8 @@ struct Instruction {
     bool     isUJ = false;
     bool     isS = false;
     bool     isSB = false;
+
+    uint16_t coverage = 0; // the point Coverage marks, see coveragePoint
 };
 
 // The following functions are the core of the simulator. Your task is to
@@ -212,6 +238,15 @@ struct Instruction {
 // Get raw instruction bits from memory
 Instruction simFetch(uint64_t PC, MemoryStore *myMem);
 
+// The instruction fetched at PC, given the 32 bits there. A compressed (RV64C)
+// instruction only uses the low 16 and is replaced by its 32-bit equivalent.
+Instruction simFetchWord(uint64_t PC, uint32_t word);
+
+// The 32-bit instruction a compressed parcel stands for, from a table of all of
+// them. A parcel that is not a supported instruction comes back unchanged, and
+// then decodes as illegal.
+uint32_t expandCompressed(uint16_t parcel);
+
 // Determine instruction opcode, funct, reg names, and what resources to use
 Instruction simDecode(Instruction inst);
 
@@ -221,7 +256,7 @@ Instruction simOperandCollection(Instruction inst, REGS regData);
 // determine the type of instruction R, I, S, SB, U, UJ and instruction type
 Instruction instructionTypeandBits(Instruction inst);
 
-// Resolve next PC whether +4 or branch/jump target
+// Resolve next PC whether the next instruction or branch/jump target
 Instruction simNextPCResolution(Instruction inst);
 
 // Perform arithmetic/logic operations
@@ -237,4 +272,9 @@ Instruction simMemAccess(Instruction inst, MemoryStore *myMem);
 Instruction simCommit(Instruction inst, REGS &regData);
 
 // Simulate the whole instruction using functions above
-Instruction simInstruction(uint64_t &PC, MemoryStore *myMem, REGS &regData);
\ No newline at end of file
+Instruction simInstruction(uint64_t &PC, MemoryStore *myMem, REGS &regData);
+
+// Run a fetched and decoded instruction through the remaining stages
+Instruction simExecute(Instruction inst, uint64_t &PC, MemoryStore *myMem, REGS &regData);
+
+#endif
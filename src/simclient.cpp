@@ -0,0 +1,261 @@
+// Client for `sim --serve`: submits jobs over the server's Unix domain socket and
+// reports throughput. With --spawn it instead starts one simulator process per job,
+// for comparison against the server.
+
+#include "Simulator.h"
+#include "SimProtocol.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+struct ClientOptions {
+    const char *socketPath = NULL;
+    const char *programFile = NULL;
+    const char *spawnSim = NULL;
+    bool sendPath = false;
+    bool initRegs = false;
+    uint64_t regs[REG_SIZE] = {0};
+    uint64_t maxInstructions = 0;
+    uint64_t repeat = 1;
+    unsigned connections = 1;
+    bool quiet = false;
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <socket> <instruction_file>\n", prog);
+    fprintf(stderr, "       %s --spawn <sim> [options] <instruction_file>\n", prog);
+    fprintf(stderr, "  --path             send the program path instead of its bytes\n");
+    fprintf(stderr, "  --reg <n>=<value>  initial value of register xn\n");
+    fprintf(stderr, "  --max-insts <n>    instruction budget per job\n");
+    fprintf(stderr, "  --repeat <n>       run the job n times and report jobs/sec\n");
+    fprintf(stderr, "  --connections <n>  spread the jobs over n parallel connections\n");
+    fprintf(stderr, "  --quiet            do not write reg_state.out and mem_state.out\n");
+}
+
+static int connectTo(const char *socketPath) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror(socketPath);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+static bool writeFile(const char *path, const string &text) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        return false;
+    }
+    fwrite(text.data(), 1, text.size(), f);
+    return fclose(f) == 0;
+}
+
+// The last response of a connection, with the text that follows it.
+struct JobResult {
+    JobResponse response;
+    string regDump;
+    string memDump;
+    string output;
+    string error;
+};
+
+// Sends count jobs over one connection; the last result is left in result.
+static bool runJobs(const ClientOptions &opts, const vector<uint8_t> &payload, uint64_t count,
+                    JobResult &result) {
+    int fd = connectTo(opts.socketPath);
+    if (fd < 0) {
+        return false;
+    }
+
+    JobRequest request;
+    memset(&request, 0, sizeof(request));
+    request.magic = JOB_REQUEST_MAGIC;
+    request.version = SIM_PROTOCOL_VERSION;
+    request.flags = (opts.sendPath ? JOB_PROGRAM_PATH : 0) | (opts.initRegs ? JOB_INIT_REGS : 0);
+    request.maxInstructions = opts.maxInstructions;
+    request.payloadLength = payload.size();
+
+    JobResponse &response = result.response;
+    bool ok = true;
+    for (uint64_t i = 0; i < count && ok; i++) {
+        ok = writeFull(fd, &request, sizeof(request))
+          && (!opts.initRegs || writeFull(fd, opts.regs, sizeof(opts.regs)))
+          && writeFull(fd, payload.data(), payload.size())
+          && readFull(fd, &response, sizeof(response))
+          && response.magic == JOB_RESPONSE_MAGIC && response.version == SIM_PROTOCOL_VERSION;
+        if (ok) {
+            result.regDump.resize(response.regDumpLength);
+            result.memDump.resize(response.memDumpLength);
+            result.output.resize(response.outputLength);
+            result.error.resize(response.errorLength);
+            ok = readFull(fd, &result.regDump[0], result.regDump.size())
+              && readFull(fd, &result.memDump[0], result.memDump.size())
+              && readFull(fd, &result.output[0], result.output.size())
+              && readFull(fd, &result.error[0], result.error.size());
+        }
+    }
+    close(fd);
+    if (!ok) {
+        fprintf(stderr, "Lost connection to %s\n", opts.socketPath);
+    }
+    return ok;
+}
+
+// Runs the job count times as separate simulator processes; returns the last exit status.
+static int spawnJobs(const ClientOptions &opts, uint64_t count) {
+    int status = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int devNull = open("/dev/null", O_WRONLY);
+            dup2(devNull, STDOUT_FILENO);
+            execl(opts.spawnSim, opts.spawnSim, opts.programFile, (char *)NULL);
+            _exit(126);
+        }
+        if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+            perror("fork");
+            return -1;
+        }
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static const char *statusName(uint16_t status) {
+    switch (status) {
+        case SIM_RUNNING: return "budget exhausted";
+        case SIM_HALTED: return "halted";
+        case SIM_ILLEGAL: return "illegal instruction";
+        case JOB_BAD_REQUEST: return "bad request";
+        case JOB_LOAD_FAILED: return "load failed";
+        case JOB_SPINNING: return "endless loop";
+    }
+    return "unknown";
+}
+
+int main(int argc, char **argv) {
+    ClientOptions opts;
+    vector<const char *> positional;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--path") == 0) {
+            opts.sendPath = true;
+        }
+        else if (strcmp(argv[i], "--spawn") == 0 && i + 1 < argc) {
+            opts.spawnSim = argv[++i];
+        }
+        else if (strcmp(argv[i], "--reg") == 0 && i + 1 < argc) {
+            char *end;
+            unsigned long index = strtoul(argv[++i], &end, 0);
+            if (*end != '=' || index == 0 || index >= REG_SIZE) {
+                usage(argv[0]);
+                return -1;
+            }
+            opts.regs[index] = strtoull(end + 1, NULL, 0);
+            opts.initRegs = true;
+        }
+        else if (strcmp(argv[i], "--max-insts") == 0 && i + 1 < argc) {
+            opts.maxInstructions = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            opts.repeat = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+            opts.connections = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--quiet") == 0) {
+            opts.quiet = true;
+        }
+        else if (argv[i][0] != '-') {
+            positional.push_back(argv[i]);
+        }
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (positional.size() != (opts.spawnSim ? 1u : 2u) || opts.repeat == 0 || opts.connections == 0) {
+        usage(argv[0]);
+        return -1;
+    }
+    opts.programFile = positional.back();
+    opts.socketPath = opts.spawnSim ? NULL : positional[0];
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int exitCode = 0;
+    if (opts.spawnSim != NULL) {
+        exitCode = spawnJobs(opts, opts.repeat);
+    }
+    else {
+        vector<uint8_t> payload;
+        if (opts.sendPath) {
+            payload.assign(opts.programFile, opts.programFile + strlen(opts.programFile));
+        }
+        else if (!loadProgramImage(opts.programFile, payload)) {
+            return -1;
+        }
+
+        // the first connection also carries the remainder of an uneven split
+        vector<JobResult> results(opts.connections);
+        vector<char> ok(opts.connections);
+        vector<thread> threads;
+        for (unsigned c = 0; c < opts.connections; c++) {
+            uint64_t count = opts.repeat / opts.connections + (c == 0 ? opts.repeat % opts.connections : 0);
+            threads.push_back(thread([&, c, count] {
+                ok[c] = count == 0 || runJobs(opts, payload, count, results[c]);
+            }));
+        }
+        for (size_t c = 0; c < threads.size(); c++) {
+            threads[c].join();
+            if (!ok[c]) {
+                return -1;
+            }
+        }
+
+        // the program's output first, as sim prints it
+        const JobResponse &last = results[0].response;
+        fwrite(results[0].output.data(), 1, results[0].output.size(), stdout);
+        fflush(stdout);
+        fwrite(results[0].error.data(), 1, results[0].error.size(), stderr);
+        fprintf(stderr, "%s after %llu instructions at PC 0x%llx (%.1f us in server)\n",
+                statusName(last.status), (unsigned long long)last.instructions,
+                (unsigned long long)last.pc, last.elapsedNs / 1000.0);
+        if (!opts.quiet && (last.status <= SIM_ILLEGAL || last.status == JOB_SPINNING)) {
+            writeFile("reg_state.out", results[0].regDump);
+            writeFile("mem_state.out", results[0].memDump);
+        }
+        // the exit codes of sim for the same outcomes
+        switch (last.status) {
+            case SIM_HALTED:   exitCode = 0; break;
+            case SIM_ILLEGAL:  exitCode = 127; break;
+            case SIM_RUNNING:  exitCode = 125; break;
+            case JOB_SPINNING: exitCode = 126; break;
+            default:           exitCode = 1; break;
+        }
+        if (last.exited) {
+            exitCode = last.exitCode;
+        }
+    }
+
+    if (opts.repeat > 1) {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        fprintf(stderr, "%llu jobs in %.3f s: %.0f jobs/sec\n",
+                (unsigned long long)opts.repeat, seconds, opts.repeat / seconds);
+    }
+    return exitCode;
+}
@@ -0,0 +1,90 @@
+// Converts binary dumps written by sim --dump-binary back into the text dumps
+// (reg_state.out / mem_state.out, or the .reg_state.ref / .mem_state.ref pair
+// used by the tests).
+
+#include "BinaryDump.h"
+#include "PagedMemoryStore.h"
+#include "StateDump.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+
+using namespace std;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <dump_file> [<name>]\n", prog);
+    fprintf(stderr, "  --list          print the records instead of converting\n");
+    fprintf(stderr, "  --record <n>    convert the state after record n (default: the last)\n");
+    fprintf(stderr, "With <name>, writes <name>.reg_state.ref and <name>.mem_state.ref instead\n");
+    fprintf(stderr, "of reg_state.out and mem_state.out.\n");
+}
+
+int main(int argc, char **argv) {
+    bool list = false;
+    long long lastRecord = -1;
+    const char *dumpFile = NULL;
+    const char *name = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--list") == 0) {
+            list = true;
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            lastRecord = strtoll(argv[++i], NULL, 0);
+        }
+        else if (argv[i][0] != '-' && dumpFile == NULL) {
+            dumpFile = argv[i];
+        }
+        else if (argv[i][0] != '-' && name == NULL) {
+            name = argv[i];
+        }
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (dumpFile == NULL) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    FILE *f = fopen(dumpFile, "rb");
+    if (f == NULL) {
+        perror(dumpFile);
+        return -1;
+    }
+    DumpState state;
+    DumpRecordInfo info;
+    long long records = 0;
+    int result = 0;
+    while ((lastRecord < 0 || records <= lastRecord) && (result = readDumpRecord(f, state, info)) > 0) {
+        if (list) {
+            printf("%6lld  %-5s  %14lu instructions  pc 0x%08lx  %4u pages\n", records,
+                   info.kind == DUMP_FULL ? "full" : "delta", info.instructionCount, info.pc, info.pageCount);
+        }
+        records++;
+    }
+    fclose(f);
+    if (result < 0) {
+        return -1;
+    }
+    if (records == 0 || (lastRecord >= 0 && records <= lastRecord)) {
+        fprintf(stderr, "%s: has %lld records\n", dumpFile, records);
+        return -1;
+    }
+    if (list) {
+        return 0;
+    }
+
+    PagedMemoryStore mem;
+    mem.loadImage(state.memory);
+    if (name == NULL) {
+        writeStateFiles(state.regs.reg, &mem);
+    }
+    else {
+        string base = name;
+        writeStateFiles(state.regs.reg, &mem, (base + ".reg_state.ref").c_str(), (base + ".mem_state.ref").c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,1027 @@
+// Differential fuzzer for the decode and execute stages.
+//
+// Generates random RV64IMC programs and runs each one in lockstep on every engine:
+// the staged reference (simInstruction, fetching and decoding every time), the
+// predecoded Simulator, and a compact model written straight from the ISA manual.
+// State is compared after every block of instructions. A program on which the
+// engines disagree is minimized and written out as a .s test. With --decode it
+// instead checks simDecode's legality verdict on random words against the model.
+
+#include "Disassembler.h"
+#include "Simulator.h"
+#include "Syscalls.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+
+using namespace std;
+
+// instructions between full register and memory comparisons
+static const uint64_t BLOCK_STEPS = 16;
+// steps before a program counts as runaway (stores can turn code into loops)
+static const uint64_t STEP_BUDGET = 4096;
+// random bytes after the initial register table, for loads and stores
+static const uint64_t DATA_BYTES = 256;
+
+static const uint32_t HALT_WORD = 0xfeedfeed;
+static const uint32_t NOP_WORD = 0x00000013;
+
+// --------------------------------------------------------------------------
+// Encodings
+// --------------------------------------------------------------------------
+
+static uint32_t encR(uint32_t op, uint32_t f3, uint32_t f7, uint32_t rd, uint32_t rs1, uint32_t rs2) {
+    return (f7 << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+}
+
+static uint32_t encI(uint32_t op, uint32_t f3, uint32_t rd, uint32_t rs1, int32_t imm) {
+    return ((uint32_t)imm << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+}
+
+static uint32_t encS(uint32_t f3, uint32_t rs1, uint32_t rs2, int32_t imm) {
+    uint32_t u = imm & 0xfff;
+    return ((u >> 5) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | ((u & 31) << 7) | OP_STORE;
+}
+
+static uint32_t encB(uint32_t f3, uint32_t rs1, uint32_t rs2, int32_t offset) {
+    uint32_t u = offset & 0x1fff;
+    return (((u >> 12) & 1) << 31) | (((u >> 5) & 63) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) |
+           (((u >> 1) & 15) << 8) | (((u >> 11) & 1) << 7) | OP_SBTYPE;
+}
+
+static uint32_t encJ(uint32_t rd, int32_t offset) {
+    uint32_t u = offset & 0x1fffff;
+    return (((u >> 20) & 1) << 31) | (((u >> 1) & 1023) << 21) | (((u >> 11) & 1) << 20) |
+           (((u >> 12) & 255) << 12) | (rd << 7) | OP_JAL;
+}
+
+// The compressed branches: c.beqz (bne false) or c.bnez on x8..x15.
+static uint16_t encCB(bool bne, uint32_t rs1, int32_t offset) {
+    uint32_t u = offset & 0x1ff;
+    return ((bne ? 7 : 6) << 13) | (((u >> 8) & 1) << 12) | (((u >> 3) & 3) << 10) | ((rs1 - 8) << 7) |
+           (((u >> 6) & 3) << 5) | (((u >> 1) & 3) << 3) | (((u >> 5) & 1) << 2) | 1;
+}
+
+// c.j
+static uint16_t encCJ(int32_t offset) {
+    uint32_t u = offset & 0xfff;
+    return (5 << 13) | (((u >> 11) & 1) << 12) | (((u >> 4) & 1) << 11) | (((u >> 8) & 3) << 9) |
+           (((u >> 10) & 1) << 8) | (((u >> 6) & 1) << 7) | (((u >> 7) & 1) << 6) | (((u >> 1) & 7) << 3) |
+           (((u >> 5) & 1) << 2) | 1;
+}
+
+// --------------------------------------------------------------------------
+// Reference model
+// --------------------------------------------------------------------------
+
+static int64_t sext(uint64_t value, int bits) {
+    return (int64_t)(value << (64 - bits)) >> (64 - bits);
+}
+
+// Whether w is a legal instruction of the simulated subset, per the ISA manual.
+static bool specLegal(uint32_t w) {
+    uint32_t f3 = (w >> 12) & 7;
+    uint32_t f7 = w >> 25;
+    uint32_t f6 = w >> 26;
+    switch (w & 0x7f) {
+        case OP_INTIMM:
+            if (f3 == 1) return f6 == 0;
+            if (f3 == 5) return f6 == 0 || f6 == 0x10;
+            return true;
+        case OP_INTIMMW:
+            if (f3 == 0) return true;
+            if (f3 == 1) return f7 == 0;
+            if (f3 == 5) return f7 == 0 || f7 == 0x20;
+            return false;
+        case OP_RTYPE:
+            if (f7 == 1) return true; // M extension
+            if (f3 == 0 || f3 == 5) return f7 == 0 || f7 == 0x20;
+            return f7 == 0;
+        case OP_RTYPEW:
+            if (f7 == 1) return f3 == 0 || f3 >= 4;
+            if (f3 == 0 || f3 == 5) return f7 == 0 || f7 == 0x20;
+            if (f3 == 1) return f7 == 0;
+            return false;
+        case OP_LOAD:   return f3 != 7;
+        case OP_STORE:  return f3 <= 3;
+        case OP_SBTYPE: return f3 != 2 && f3 != 3;
+        case OP_JALR:   return f3 == 0;
+        case OP_LUI:
+        case OP_AUIPC:
+        case OP_JAL:    return true;
+        case OP_SYSTEM: return w == 0x00000073; // ecall
+    }
+    return false;
+}
+
+// High 64 bits of the unsigned product, from 32-bit halves.
+static uint64_t mulhu(uint64_t a, uint64_t b) {
+    uint64_t al = a & 0xffffffff, ah = a >> 32, bl = b & 0xffffffff, bh = b >> 32;
+    uint64_t low = al * bl, mid1 = ah * bl, mid2 = al * bh;
+    uint64_t carry = ((low >> 32) + (mid1 & 0xffffffff) + (mid2 & 0xffffffff)) >> 32;
+    return ah * bh + (mid1 >> 32) + (mid2 >> 32) + carry;
+}
+
+// Division as the M extension defines it, for width 32 or 64 (operands already sign
+// or zero extended from that width): x / 0 is all ones with remainder x, and the
+// overflowing signed division gives the dividend with remainder 0.
+static uint64_t divide(uint64_t a, uint64_t b, bool isSigned, bool remainder, int width) {
+    uint64_t minValue = 1ULL << (width - 1);
+    if (b == 0) {
+        return remainder ? a : ~0ULL;
+    }
+    if (!isSigned) {
+        return remainder ? a % b : a / b;
+    }
+    if (b == ~0ULL && a == (uint64_t)sext(minValue, width)) {
+        return remainder ? 0 : a;
+    }
+    bool negA = (int64_t)a < 0, negB = (int64_t)b < 0;
+    uint64_t ma = negA ? 0 - a : a, mb = negB ? 0 - b : b;
+    if (remainder) {
+        // the remainder takes the sign of the dividend
+        return negA ? 0 - ma % mb : ma % mb;
+    }
+    return negA != negB ? 0 - ma / mb : ma / mb;
+}
+
+// The 32-bit instruction a compressed parcel stands for, per the RVC chapter of the
+// ISA manual, or 0 if it is reserved or a floating point one.
+static uint32_t specExpand(uint32_t c) {
+    // c[hi:lo] placed at bit at
+    auto bits = [c](int hi, int lo, int at) { return ((c >> lo) & ((1u << (hi - lo + 1)) - 1)) << at; };
+    uint32_t r = bits(11, 7, 0), r2 = bits(6, 2, 0), rp = 8 + bits(9, 7, 0), r2p = 8 + bits(4, 2, 0);
+    int32_t ci = (int32_t)sext(bits(12, 12, 5) | bits(6, 2, 0), 6);
+    uint32_t shamt = bits(12, 12, 5) | bits(6, 2, 0);
+    uint32_t wOff = bits(12, 10, 3) | bits(6, 6, 2) | bits(5, 5, 6);
+    uint32_t dOff = bits(12, 10, 3) | bits(6, 5, 6);
+    unsigned f3 = c >> 13;
+    switch (c & 3) {
+        case 0:
+            switch (f3) {
+                case 0: {
+                    uint32_t imm = bits(12, 11, 4) | bits(10, 7, 6) | bits(6, 6, 2) | bits(5, 5, 3);
+                    return imm ? encI(OP_INTIMM, 0, r2p, 2, imm) : 0;
+                }
+                case 2: return encI(OP_LOAD, 2, r2p, rp, wOff);
+                case 3: return encI(OP_LOAD, 3, r2p, rp, dOff);
+                case 6: return encS(2, rp, r2p, wOff);
+                case 7: return encS(3, rp, r2p, dOff);
+            }
+            return 0;
+        case 1:
+            switch (f3) {
+                case 0: return encI(OP_INTIMM, 0, r, r, ci);
+                case 1: return r ? encI(OP_INTIMMW, 0, r, r, ci) : 0;
+                case 2: return encI(OP_INTIMM, 0, r, 0, ci);
+                case 3:
+                    if (r == 2) {
+                        int32_t imm = (int32_t)sext(bits(12, 12, 9) | bits(6, 6, 4) | bits(5, 5, 6) | bits(4, 3, 7) | bits(2, 2, 5), 10);
+                        return imm ? encI(OP_INTIMM, 0, 2, 2, imm) : 0;
+                    }
+                    return ci ? ((uint32_t)ci << 12) | (r << 7) | OP_LUI : 0;
+                case 4: {
+                    unsigned kind = bits(11, 10, 0), sub = bits(6, 5, 0);
+                    if (kind == 0) return encI(OP_INTIMM, 5, rp, rp, shamt);
+                    if (kind == 1) return encI(OP_INTIMM, 5, rp, rp, 0x400 | shamt);
+                    if (kind == 2) return encI(OP_INTIMM, 7, rp, rp, ci);
+                    if (!bits(12, 12, 0)) {
+                        static const uint32_t f3s[] = {0, 4, 6, 7};
+                        return encR(OP_RTYPE, f3s[sub], sub == 0 ? 0x20 : 0, rp, rp, r2p);
+                    }
+                    if (sub < 2) return encR(OP_RTYPEW, 0, sub == 0 ? 0x20 : 0, rp, rp, r2p);
+                    return 0;
+                }
+                case 5:
+                    return encJ(0, (int32_t)sext(bits(12, 12, 11) | bits(11, 11, 4) | bits(10, 9, 8) | bits(8, 8, 10) |
+                                                 bits(7, 7, 6) | bits(6, 6, 7) | bits(5, 3, 1) | bits(2, 2, 5), 12));
+                default:
+                    return encB(f3 == 6 ? 0 : 1, rp, 0, (int32_t)sext(bits(12, 12, 8) | bits(11, 10, 3) | bits(6, 5, 6) |
+                                                                      bits(4, 3, 1) | bits(2, 2, 5), 9));
+            }
+        case 2:
+            switch (f3) {
+                case 0: return encI(OP_INTIMM, 1, r, r, shamt);
+                case 2: return r ? encI(OP_LOAD, 2, r, 2, bits(12, 12, 5) | bits(6, 4, 2) | bits(3, 2, 6)) : 0;
+                case 3: return r ? encI(OP_LOAD, 3, r, 2, bits(12, 12, 5) | bits(6, 5, 3) | bits(4, 2, 6)) : 0;
+                case 4:
+                    if (r2 != 0) return encR(OP_RTYPE, 0, 0, r, bits(12, 12, 0) ? r : 0, r2); // c.add, c.mv
+                    if (r == 0) return 0; // reserved, c.ebreak
+                    return encI(OP_JALR, 0, bits(12, 12, 0), r, 0); // c.jalr, c.jr
+                case 6: return encS(2, 2, r2, bits(12, 9, 2) | bits(8, 7, 6));
+                case 7: return encS(3, 2, r2, bits(12, 10, 3) | bits(9, 7, 6));
+            }
+            return 0;
+    }
+    return 0;
+}
+
+// Straight-line interpreter that shares no code with the simulator.
+struct SpecModel {
+    uint64_t x[REG_SIZE];
+    uint64_t pc;
+    uint64_t count;
+    SimStatus status;
+    vector<uint8_t> mem;
+    uint64_t dirty; // written 1 KiB pages
+    uint64_t heapStart;
+    uint64_t programBreak;
+
+    SpecModel() : mem(MEMORY_SIZE, 0) {}
+
+    void load(const vector<uint8_t> &image) {
+        fill(mem.begin(), mem.end(), 0);
+        copy(image.begin(), image.begin() + min<size_t>(image.size(), MEMORY_SIZE), mem.begin());
+        memset(x, 0, sizeof(x));
+        pc = 0;
+        count = 0;
+        status = SIM_RUNNING;
+        dirty = 0;
+        heapStart = (image.size() + 7) / 8 * 8;
+        programBreak = heapStart;
+    }
+
+    // The Linux calls the engines emulate, with no input and output going nowhere.
+    // Returns false on exit.
+    bool syscall() {
+        uint64_t nr = x[17], a0 = x[10], buffer = x[11], count = x[12];
+        bool inRange = buffer + count <= MEMORY_SIZE && buffer + count >= buffer;
+        switch (nr) {
+            case 63: x[10] = a0 != 0 ? -9 : !inRange ? -14 : 0; break;
+            case 64: x[10] = a0 != 1 && a0 != 2 ? -9 : !inRange ? -14 : count; break;
+            case 93:
+            case 94: return false;
+            case 214:
+                if (a0 >= heapStart && a0 <= MEMORY_SIZE) {
+                    programBreak = a0;
+                }
+                x[10] = programBreak;
+                break;
+            default: x[10] = -38; break;
+        }
+        return true;
+    }
+
+    // out of range accesses read zero and write nothing, like PagedMemoryStore
+    uint64_t read(uint64_t addr, unsigned size) {
+        uint64_t value = 0;
+        if (addr + size <= MEMORY_SIZE && addr + size > addr) {
+            for (unsigned i = 0; i < size; i++) {
+                value |= (uint64_t)mem[addr + i] << (8 * i);
+            }
+        }
+        return value;
+    }
+
+    void write(uint64_t addr, uint64_t value, unsigned size) {
+        if (addr + size <= MEMORY_SIZE && addr + size > addr) {
+            for (unsigned i = 0; i < size; i++) {
+                mem[addr + i] = value >> (8 * i);
+            }
+            dirty |= 1ULL << (addr >> MEM_PAGE_SHIFT);
+            dirty |= 1ULL << ((addr + size - 1) >> MEM_PAGE_SHIFT);
+        }
+    }
+
+    void step() {
+        if (status != SIM_RUNNING) {
+            return;
+        }
+        // a compressed instruction may sit in the last parcel of memory
+        uint32_t w = pc + 4 > MEMORY_SIZE ? read(pc, 2) : read(pc, 4);
+        unsigned length = 4;
+        if (w != HALT_WORD && (w & 3) != 3) {
+            w = specExpand(w & 0xffff);
+            length = 2;
+            if (w == 0) {
+                status = SIM_ILLEGAL;
+                return;
+            }
+        }
+        if (w == HALT_WORD) {
+            status = SIM_HALTED;
+            return;
+        }
+        if (w == NOP_WORD) {
+            pc += length;
+            count++;
+            return;
+        }
+        if (!specLegal(w)) {
+            status = SIM_ILLEGAL;
+            return;
+        }
+
+        unsigned rd = (w >> 7) & 31, rs1 = (w >> 15) & 31, rs2 = (w >> 20) & 31, f3 = (w >> 12) & 7;
+        bool alt = (w >> 30) & 1;
+        uint64_t a = x[rs1], b = x[rs2];
+        int64_t immI = sext(w >> 20, 12);
+        int64_t immS = sext(((w >> 25) << 5) | ((w >> 7) & 31), 12);
+        int64_t immB = sext(((w >> 31) << 12) | (((w >> 7) & 1) << 11) | (((w >> 25) & 63) << 5) | (((w >> 8) & 15) << 1), 13);
+        int64_t immU = sext(w & 0xfffff000, 32);
+        int64_t immJ = sext(((w >> 31) << 20) | (((w >> 12) & 255) << 12) | (((w >> 20) & 1) << 11) | (((w >> 21) & 1023) << 1), 21);
+
+        uint64_t next = pc + length;
+        uint64_t result = 0;
+        bool writes = true;
+        switch (w & 0x7f) {
+            case OP_INTIMM: {
+                unsigned sh = (w >> 20) & 63;
+                switch (f3) {
+                    case 0: result = a + immI; break;
+                    case 1: result = a << sh; break;
+                    case 2: result = (int64_t)a < immI; break;
+                    case 3: result = a < (uint64_t)immI; break;
+                    case 4: result = a ^ immI; break;
+                    case 5: result = alt ? (uint64_t)((int64_t)a >> sh) : a >> sh; break;
+                    case 6: result = a | immI; break;
+                    case 7: result = a & immI; break;
+                }
+                break;
+            }
+            case OP_INTIMMW: {
+                unsigned sh = (w >> 20) & 31;
+                switch (f3) {
+                    case 0: result = sext((uint32_t)(a + immI), 32); break;
+                    case 1: result = sext((uint32_t)a << sh, 32); break;
+                    case 5: result = alt ? sext((uint32_t)((int32_t)a >> sh), 32) : sext((uint32_t)a >> sh, 32); break;
+                }
+                break;
+            }
+            case OP_RTYPE: {
+                unsigned sh = b & 63;
+                if ((w >> 25) == 1) {
+                    switch (f3) {
+                        case 0: result = a * b; break;
+                        case 1: result = mulhu(a, b) - ((int64_t)a < 0 ? b : 0) - ((int64_t)b < 0 ? a : 0); break;
+                        case 2: result = mulhu(a, b) - ((int64_t)a < 0 ? b : 0); break;
+                        case 3: result = mulhu(a, b); break;
+                        default: result = divide(a, b, !(f3 & 1), f3 >= 6, 64); break;
+                    }
+                    break;
+                }
+                switch (f3) {
+                    case 0: result = alt ? a - b : a + b; break;
+                    case 1: result = a << sh; break;
+                    case 2: result = (int64_t)a < (int64_t)b; break;
+                    case 3: result = a < b; break;
+                    case 4: result = a ^ b; break;
+                    case 5: result = alt ? (uint64_t)((int64_t)a >> sh) : a >> sh; break;
+                    case 6: result = a | b; break;
+                    case 7: result = a & b; break;
+                }
+                break;
+            }
+            case OP_RTYPEW: {
+                unsigned sh = b & 31;
+                if ((w >> 25) == 1) {
+                    if (f3 == 0) {
+                        result = sext((uint32_t)(a * b), 32);
+                    }
+                    else if (f3 & 1) {
+                        result = sext((uint32_t)divide((uint32_t)a, (uint32_t)b, false, f3 >= 6, 32), 32);
+                    }
+                    else {
+                        result = sext((uint32_t)divide(sext(a, 32), sext(b, 32), true, f3 >= 6, 32), 32);
+                    }
+                    break;
+                }
+                switch (f3) {
+                    case 0: result = sext((uint32_t)(alt ? a - b : a + b), 32); break;
+                    case 1: result = sext((uint32_t)a << sh, 32); break;
+                    case 5: result = alt ? sext((uint32_t)((int32_t)a >> sh), 32) : sext((uint32_t)a >> sh, 32); break;
+                }
+                break;
+            }
+            case OP_LOAD: {
+                unsigned size = 1 << (f3 & 3);
+                uint64_t value = read(a + immI, size);
+                result = (f3 & 4) || size == 8 ? value : (uint64_t)sext(value, 8 * size);
+                break;
+            }
+            case OP_STORE:
+                write(a + immS, b, 1 << f3);
+                writes = false;
+                break;
+            case OP_SBTYPE: {
+                bool taken = false;
+                switch (f3) {
+                    case 0: taken = a == b; break;
+                    case 1: taken = a != b; break;
+                    case 4: taken = (int64_t)a < (int64_t)b; break;
+                    case 5: taken = (int64_t)a >= (int64_t)b; break;
+                    case 6: taken = a < b; break;
+                    case 7: taken = a >= b; break;
+                }
+                if (taken) {
+                    next = pc + immB;
+                }
+                writes = false;
+                break;
+            }
+            case OP_LUI:   result = immU; break;
+            case OP_AUIPC: result = pc + immU; break;
+            case OP_JAL:   result = pc + length; next = pc + immJ; break;
+            case OP_JALR:  result = pc + length; next = (a + immI) & ~1ULL; break;
+            case OP_SYSTEM:
+                if (!syscall()) {
+                    status = SIM_HALTED;
+                }
+                writes = false;
+                break;
+        }
+        if (writes && rd != 0) {
+            x[rd] = result;
+        }
+        pc = next;
+        count++;
+    }
+};
+
+// --------------------------------------------------------------------------
+// Engines under test
+// --------------------------------------------------------------------------
+
+// simInstruction with no predecoding, on its own memory.
+struct StagedEngine {
+    PagedMemoryStore mem;
+    REGS regs;
+    uint64_t pc;
+    uint64_t count;
+    SimStatus status;
+    HostOutput discard;
+    SyscallEmulator syscalls;
+
+    StagedEngine() : discard(-1), syscalls(discard, discard, -1) {}
+
+    void load(const vector<uint8_t> &image) {
+        mem.loadImage(image);
+        syscalls.reset(image.size());
+        regs.reg = {};
+        pc = 0;
+        count = 0;
+        status = SIM_RUNNING;
+    }
+
+    void step() {
+        if (status != SIM_RUNNING) {
+            return;
+        }
+        Instruction inst = simInstruction(pc, &mem, regs);
+        if (inst.isHalt) {
+            status = SIM_HALTED;
+        }
+        else if (!inst.isLegal && !inst.isNop) {
+            status = SIM_ILLEGAL;
+        }
+        else {
+            if (inst.isEcall && !syscalls.handle(regs, &mem)) {
+                status = SIM_HALTED;
+            }
+            count++;
+        }
+    }
+};
+
+struct Engines {
+    StagedEngine staged;
+    PagedMemoryStore predecodedMem;
+    Simulator predecoded;
+    HostOutput discard;
+    SyscallEmulator predecodedSyscalls;
+    SpecModel spec;
+
+    Engines() : predecoded(&predecodedMem), discard(-1), predecodedSyscalls(discard, discard, -1) {
+        // wild jumps and loads are expected here
+        staged.mem.setReportErrors(false);
+        predecodedMem.setReportErrors(false);
+        predecoded.setSyscalls(&predecodedSyscalls);
+    }
+
+    void load(const vector<uint8_t> &image) {
+        staged.load(image);
+        predecoded.load(image);
+        spec.load(image);
+    }
+
+    bool running() const {
+        return staged.status == SIM_RUNNING || predecoded.getStatus() == SIM_RUNNING ||
+               spec.status == SIM_RUNNING;
+    }
+
+    void step() {
+        staged.step();
+        predecoded.step();
+        spec.step();
+    }
+};
+
+static const char *statusName(SimStatus status) {
+    switch (status) {
+        case SIM_RUNNING: return "running";
+        case SIM_HALTED:  return "halted";
+        case SIM_ILLEGAL: return "illegal";
+        case SIM_BREAKPOINT: return "breakpoint";
+        case SIM_WATCHPOINT: return "watchpoint";
+    }
+    return "?";
+}
+
+// Describes the first difference between the engines, or returns "" if none.
+// Registers and memory are only compared when full is set.
+static string compareEngines(Engines &e, bool full) {
+    char text[256];
+    const uint64_t pcs[3] = {e.staged.pc, e.predecoded.getPC(), e.spec.pc};
+    const SimStatus statuses[3] = {e.staged.status, e.predecoded.getStatus(), e.spec.status};
+    const uint64_t counts[3] = {e.staged.count, e.predecoded.getInstructionCount(), e.spec.count};
+    if (pcs[0] != pcs[1] || pcs[0] != pcs[2] || statuses[0] != statuses[1] || statuses[0] != statuses[2] ||
+        counts[0] != counts[1] || counts[0] != counts[2]) {
+        snprintf(text, sizeof(text),
+                 "staged %s at 0x%lx after %lu, predecoded %s at 0x%lx after %lu, model %s at 0x%lx after %lu",
+                 statusName(statuses[0]), pcs[0], counts[0], statusName(statuses[1]), pcs[1], counts[1],
+                 statusName(statuses[2]), pcs[2], counts[2]);
+        return text;
+    }
+    if (!full) {
+        return "";
+    }
+
+    for (unsigned r = 1; r < REG_SIZE; r++) {
+        uint64_t staged = e.staged.regs.registers[r], predecoded = e.predecoded.getReg(r), model = e.spec.x[r];
+        if (staged != predecoded || staged != model) {
+            snprintf(text, sizeof(text), "x%u after %lu instructions at 0x%lx: staged 0x%lx, predecoded 0x%lx, model 0x%lx",
+                     r, counts[0], pcs[0], staged, predecoded, model);
+            return text;
+        }
+    }
+
+    const uint8_t *staged = e.staged.mem.data(), *predecoded = e.predecodedMem.data(), *model = e.spec.mem.data();
+    for (uint64_t page = 0; page < MEM_NUM_PAGES; page++) {
+        if (!e.staged.mem.isDirty(page) && !e.predecodedMem.isDirty(page) && !((e.spec.dirty >> page) & 1)) {
+            continue;
+        }
+        for (uint64_t addr = page * MEM_PAGE_SIZE; addr < (page + 1) * MEM_PAGE_SIZE; addr++) {
+            if (staged[addr] != predecoded[addr] || staged[addr] != model[addr]) {
+                snprintf(text, sizeof(text), "byte 0x%lx after %lu instructions: staged 0x%02x, predecoded 0x%02x, model 0x%02x",
+                         addr, counts[0], staged[addr], predecoded[addr], model[addr]);
+                return text;
+            }
+        }
+    }
+    return "";
+}
+
+// Runs image on all engines in lockstep; returns the first divergence or "".
+static string runLockstep(Engines &e, const vector<uint8_t> &image, uint64_t &steps) {
+    e.load(image);
+    for (steps = 0; steps < STEP_BUDGET && e.running(); steps++) {
+        e.step();
+        bool blockEnd = (steps + 1) % BLOCK_STEPS == 0 || !e.running();
+        string diff = compareEngines(e, blockEnd);
+        if (!diff.empty()) {
+            return diff;
+        }
+    }
+    return compareEngines(e, true);
+}
+
+// --------------------------------------------------------------------------
+// Program generation
+// --------------------------------------------------------------------------
+
+// A generated program: prologue loading x1..x30 from the register table and x31
+// pointing at it, the fuzzed body, the halt word, the table, then data.
+struct Program {
+    vector<uint32_t> code;  // prologue, body, halt
+    uint64_t bodyStart;
+    uint64_t regs[REG_SIZE];
+    vector<uint8_t> data;
+
+    uint64_t tableAddress() const { return code.size() * 4; }
+
+    vector<uint8_t> image() const {
+        vector<uint8_t> bytes(code.size() * 4 + sizeof(regs) + data.size());
+        memcpy(bytes.data(), code.data(), code.size() * 4);
+        memcpy(&bytes[code.size() * 4], regs, sizeof(regs));
+        memcpy(&bytes[code.size() * 4 + sizeof(regs)], data.data(), data.size());
+        return bytes;
+    }
+};
+
+class Generator {
+    public:
+        explicit Generator(uint64_t seed) : rng(seed) {}
+
+        uint64_t next() { return rng(); }
+        uint32_t below(uint32_t n) { return rng() % n; }
+
+        Program program(unsigned bodyLength) {
+            Program p;
+            p.regs[0] = 0;
+            for (unsigned r = 1; r < REG_SIZE; r++) {
+                p.regs[r] = interestingValue();
+            }
+            p.data.resize(DATA_BYTES);
+            for (size_t i = 0; i < p.data.size(); i++) {
+                p.data[i] = rng();
+            }
+
+            // the table sits right after the code, so its address is known up front
+            uint64_t table = (1 + 30 + bodyLength + 1) * 4;
+            p.code.push_back(encI(OP_INTIMM, FUNCT3_ADD_SUB, 31, 0, table));
+            for (unsigned r = 1; r <= 30; r++) {
+                p.code.push_back(encI(OP_LOAD, FUNCT3_LD, r, 31, r * 8));
+            }
+            p.bodyStart = p.code.size();
+            for (unsigned k = 0; k < bodyLength; k++) {
+                unsigned remaining = bodyLength - k; // instructions up to and including the halt
+                if (below(50) == 0 && remaining >= 3) {
+                    // auipc rX, 0; jalr rd, off(rX) to somewhere further on
+                    uint32_t rx = 1 + below(30);
+                    p.code.push_back(encI(OP_AUIPC, 0, rx, 0, 0) & ~0xfff80u);
+                    p.code.push_back(encI(OP_JALR, FUNCT3_JALR, reg(), rx, 8 + 4 * below(remaining - 1)));
+                    k++;
+                    continue;
+                }
+                if (below(40) == 0 && remaining >= 6) {
+                    // a system call, usually with a0..a2 set up to get past the checks
+                    static const uint32_t calls[] = {SYS_READ, SYS_WRITE, SYS_WRITE, SYS_EXIT, SYS_BRK, 1000};
+                    uint32_t call = calls[below(sizeof(calls) / sizeof(calls[0]))];
+                    if (below(4) != 0) {
+                        p.code.push_back(encI(OP_INTIMM, FUNCT3_ADD_SUB, 10, 0, call == SYS_BRK ? memOffset() : below(3)));
+                        p.code.push_back(encI(OP_INTIMM, FUNCT3_ADD_SUB, 11, 31, memOffset()));
+                        p.code.push_back(encI(OP_INTIMM, FUNCT3_ADD_SUB, 12, 0, below(64)));
+                        k += 3;
+                    }
+                    p.code.push_back(encI(OP_INTIMM, FUNCT3_ADD_SUB, 17, 0, call));
+                    p.code.push_back(0x00000073);
+                    k++;
+                    continue;
+                }
+                if (below(8) == 0) {
+                    // two compressed instructions in one word
+                    p.code.push_back(compressed(remaining, 0) | (compressed(remaining, 2) << 16));
+                    continue;
+                }
+                if (below(16) == 0 && remaining >= 3) {
+                    // a 32-bit instruction 2 past a word boundary, between two compressed ones;
+                    // a branch in the middle can reach the second of them at the least
+                    uint32_t middle = instruction(1);
+                    p.code.push_back(compressed(remaining, 0) | (middle << 16));
+                    p.code.push_back((middle >> 16) | (compressed(remaining - 1, 2) << 16));
+                    k++;
+                    continue;
+                }
+                p.code.push_back(instruction(remaining));
+            }
+            p.code.push_back(HALT_WORD);
+            return p;
+        }
+
+        // A random instruction; control flow only goes forward, at most to the halt.
+        uint32_t instruction(unsigned remaining) {
+            uint32_t rd = reg(), rs1 = 1 + below(31), rs2 = 1 + below(31);
+            uint32_t f3 = below(8);
+            switch (below(20)) {
+                case 0: case 1: case 2: case 3: {
+                    if (f3 == FUNCT3_SLL || f3 == FUNCT3_SRL_SRA) {
+                        uint32_t f6 = f3 == FUNCT3_SRL_SRA && below(2) ? 0x10 : 0;
+                        return encI(OP_INTIMM, f3, rd, rs1, (f6 << 6) | shamt(63));
+                    }
+                    return encI(OP_INTIMM, f3, rd, rs1, imm12());
+                }
+                case 4: case 5: {
+                    static const uint32_t f3s[] = {FUNCT3_ADD_SUB, FUNCT3_SLL, FUNCT3_SRL_SRA};
+                    f3 = f3s[below(3)];
+                    if (f3 == FUNCT3_ADD_SUB) {
+                        return encI(OP_INTIMMW, f3, rd, rs1, imm12());
+                    }
+                    uint32_t f7 = f3 == FUNCT3_SRL_SRA && below(2) ? FUNCT7_SUB_SRA : FUNCT7_DEFAULT;
+                    return encI(OP_INTIMMW, f3, rd, rs1, (f7 << 5) | shamt(31));
+                }
+                case 6: case 7: case 8: case 9: {
+                    if (below(3) == 0) {
+                        return encR(OP_RTYPE, f3, FUNCT7_MULDIV, rd, rs1, rs2);
+                    }
+                    uint32_t f7 = (f3 == FUNCT3_ADD_SUB || f3 == FUNCT3_SRL_SRA) && below(2) ? FUNCT7_SUB_SRA : FUNCT7_DEFAULT;
+                    return encR(OP_RTYPE, f3, f7, rd, rs1, rs2);
+                }
+                case 10: case 11: {
+                    if (below(3) == 0) {
+                        static const uint32_t m3s[] = {FUNCT3_MUL, FUNCT3_DIV, FUNCT3_DIVU, FUNCT3_REM, FUNCT3_REMU};
+                        return encR(OP_RTYPEW, m3s[below(5)], FUNCT7_MULDIV, rd, rs1, rs2);
+                    }
+                    static const uint32_t f3s[] = {FUNCT3_ADD_SUB, FUNCT3_SLL, FUNCT3_SRL_SRA};
+                    f3 = f3s[below(3)];
+                    uint32_t f7 = f3 != FUNCT3_SLL && below(2) ? FUNCT7_SUB_SRA : FUNCT7_DEFAULT;
+                    return encR(OP_RTYPEW, f3, f7, rd, rs1, rs2);
+                }
+                case 12:
+                    return (uint32_t)(next() & 0xfffff000) | (rd << 7) | (below(2) ? OP_LUI : OP_AUIPC);
+                case 13: case 14: case 15:
+                    // around the register table and data, now and then reaching back into code
+                    return encI(OP_LOAD, below(7), rd, 31, memOffset());
+                case 16: case 17:
+                    return encS(below(4), 31, rs2, memOffset());
+                case 18: {
+                    static const uint32_t f3s[] = {FUNCT3_BEQ, FUNCT3_BNE, FUNCT3_BLT, FUNCT3_BGE, FUNCT3_BLTU, FUNCT3_BGEU};
+                    // equal operands make taken branches common
+                    return encB(f3s[below(6)], rs1, below(4) ? rs2 : rs1, 4 + 4 * below(remaining));
+                }
+                default:
+                    return encJ(rd, 4 + 4 * below(remaining));
+            }
+        }
+
+        // A random compressed instruction at byte at of a word, with control flow only
+        // forward to a word boundary, at most to the halt.
+        uint32_t compressed(unsigned remaining, unsigned at) {
+            if (below(8) == 0) {
+                int32_t offset = 4 * (1 + below(min(remaining, 60u))) - at;
+                return below(3) ? encCB(below(2), 8 + below(8), offset) : encCJ(offset);
+            }
+            for (;;) {
+                uint32_t c = (rng() & 0xfffc) | below(3);
+                uint32_t w = specExpand(c);
+                uint32_t op = w & 0x7f;
+                // straight-line, leaving the data base x31 alone
+                if (w != 0 && op != OP_JAL && op != OP_JALR && op != OP_SBTYPE &&
+                    (op == OP_STORE || ((w >> 7) & 31) != 31)) {
+                    return c;
+                }
+            }
+        }
+
+        // The whole 32-bit space, biased towards known opcodes.
+        uint32_t word() {
+            static const uint32_t opcodes[] = {OP_INTIMM, OP_INTIMMW, OP_LOAD, OP_RTYPE, OP_RTYPEW, OP_STORE,
+                                               OP_SBTYPE, OP_LUI, OP_AUIPC, OP_JALR, OP_JAL, OP_SYSTEM};
+            uint32_t w = rng();
+            if (below(2)) {
+                w = (w & ~0x7fu) | opcodes[below(sizeof(opcodes) / sizeof(opcodes[0]))];
+            }
+            if (below(4) == 0) {
+                // funct7 variants are rare in uniformly random words
+                static const uint32_t f7s[] = {0x00, 0x01, 0x20, 0x21, 0x40};
+                w = (w & 0x01ffffffu) | (f7s[below(5)] << 25);
+            }
+            return w;
+        }
+
+    private:
+        uint32_t reg() { return below(31); } // x0..x30, never the data base x31
+
+        uint32_t shamt(uint32_t max) {
+            static const uint32_t edges[] = {0, 1, 31, 32, 63};
+            uint32_t s = below(2) ? edges[below(5)] : below(max + 1);
+            return s > max ? max : s;
+        }
+
+        int32_t imm12() {
+            static const int32_t edges[] = {0, 1, -1, 2047, -2048};
+            return below(3) ? (int32_t)sext(rng(), 12) : edges[below(5)];
+        }
+
+        int32_t memOffset() {
+            if (below(16) == 0) {
+                return -(int32_t)(4 + below(32));
+            }
+            return below(REG_SIZE * 8 + DATA_BYTES);
+        }
+
+        uint64_t interestingValue() {
+            static const uint64_t edges[] = {0, 1, ~0ULL, 0x8000000000000000ULL, 0x7fffffffffffffffULL,
+                                             0x80000000ULL, 0x7fffffffULL, 0xffffffffULL, 0xffffffff80000000ULL,
+                                             31, 32, 63, 64};
+            switch (below(4)) {
+                case 0:  return edges[below(sizeof(edges) / sizeof(edges[0]))];
+                case 1:  return sext(rng(), 12);
+                default: return rng();
+            }
+        }
+
+        mt19937_64 rng;
+};
+
+// --------------------------------------------------------------------------
+// Minimization and reproducers
+// --------------------------------------------------------------------------
+
+// Replaces body instructions with NOPs and initial registers with zero for as long
+// as the engines still disagree.
+static void minimize(Engines &e, Program &p) {
+    uint64_t steps;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = p.bodyStart; i + 1 < p.code.size(); i++) {
+            if (p.code[i] == NOP_WORD) {
+                continue;
+            }
+            uint32_t saved = p.code[i];
+            p.code[i] = NOP_WORD;
+            if (runLockstep(e, p.image(), steps).empty()) {
+                p.code[i] = saved;
+            }
+            else {
+                changed = true;
+            }
+        }
+        for (unsigned r = 1; r < REG_SIZE - 1; r++) {
+            if (p.regs[r] == 0) {
+                continue;
+            }
+            uint64_t saved = p.regs[r];
+            p.regs[r] = 0;
+            if (runLockstep(e, p.image(), steps).empty()) {
+                p.regs[r] = saved;
+            }
+            else {
+                changed = true;
+            }
+        }
+    }
+}
+
+static bool writeReproducer(const string &path, const Program &p, const string &title, const string &diff) {
+    FILE *f = fopen(path.c_str(), "w");
+    if (f == NULL) {
+        perror(path.c_str());
+        return false;
+    }
+    fprintf(f, "# ======================================================\n");
+    fprintf(f, "# %s\n", title.c_str());
+    fprintf(f, "# %s\n", diff.c_str());
+    fprintf(f, "# ======================================================\n\n");
+    // the instructions starting in each word, compressed ones as their 32-bit equivalent
+    vector<string> notes(p.code.size());
+    const uint16_t *parcels = (const uint16_t *)p.code.data();
+    for (size_t h = 0; h < 2 * p.code.size(); ) {
+        uint32_t word = parcels[h] | (h + 1 < 2 * p.code.size() ? (uint32_t)parcels[h + 1] << 16 : 0);
+        bool isCompressed = word != HALT_WORD && (word & 3) != 3;
+        char text[DISASM_TEXT_MAX];
+        formatInstruction(simDecode(simFetchWord(2 * h, isCompressed ? specExpand(word & 0xffff) : word)), text);
+        string &note = notes[h / 2];
+        note += note.empty() ? "" : "; ";
+        note += isCompressed ? "c: " : "";
+        note += text;
+        h += isCompressed ? 1 : 2;
+    }
+
+    fprintf(f, "# ---- t6 = register table, then load x1..x30 from it ----\n");
+    for (size_t i = 0; i < p.code.size(); i++) {
+        if (i == p.bodyStart) {
+            fprintf(f, "\n# ---- fuzzed body ----\n");
+        }
+        if (p.code[i] == HALT_WORD) {
+            fprintf(f, "\n.word 0xfeedfeed\n");
+            continue;
+        }
+        fprintf(f, ".word 0x%08x    # %s\n", p.code[i], notes[i].c_str());
+    }
+    fprintf(f, "\nregs:\n");
+    for (unsigned r = 0; r < REG_SIZE; r++) {
+        fprintf(f, ".dword 0x%016lx    # x%u\n", p.regs[r], r);
+    }
+    fprintf(f, "\ndata:\n");
+    for (size_t i = 0; i < p.data.size(); i += 4) {
+        uint32_t word;
+        memcpy(&word, &p.data[i], 4);
+        fprintf(f, ".word 0x%08x\n", word);
+    }
+    return fclose(f) == 0;
+}
+
+// --------------------------------------------------------------------------
+// Driver
+// --------------------------------------------------------------------------
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options]\n", prog);
+    fprintf(stderr, "  --seed <n>        random seed (default: time)\n");
+    fprintf(stderr, "  --programs <n>    programs to run (default 100000)\n");
+    fprintf(stderr, "  --length <n>      maximum body length (default 64)\n");
+    fprintf(stderr, "  --decode <n>      check the legality of n random words instead\n");
+    fprintf(stderr, "  --out-dir <dir>   where reproducers are written (default test)\n");
+    fprintf(stderr, "  --replay <file>   run one program binary on every engine\n");
+}
+
+// Compares simDecode's legality verdict with the model's on count random words, most
+// of which start with a compressed instruction.
+static int fuzzDecode(Generator &gen, uint64_t count, const string &outDir, uint64_t seed) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (uint64_t i = 0; i < count; i++) {
+        uint32_t w = gen.word();
+        Instruction inst = simDecode(simFetchWord(0, w));
+        bool simLegal = inst.isLegal || inst.isNop || inst.isHalt;
+        bool compressed = w != HALT_WORD && (w & 3) != 3;
+        bool modelLegal = compressed ? specExpand(w & 0xffff) != 0 : w == HALT_WORD || w == NOP_WORD || specLegal(w);
+        if (simLegal != modelLegal) {
+            char title[128], diff[128], path[64];
+            snprintf(title, sizeof(title), "FUZZ: decode of 0x%08x (simfuzz --seed %lu --decode)", w, seed);
+            snprintf(diff, sizeof(diff), "simDecode says %s, the ISA manual says %s",
+                     simLegal ? "legal" : "illegal", modelLegal ? "legal" : "illegal");
+            snprintf(path, sizeof(path), "/fuzz_decode_%08x.s", w);
+            fprintf(stderr, "%s\n%s\n", title, diff);
+
+            Program p;
+            memset(p.regs, 0, sizeof(p.regs));
+            p.bodyStart = 0;
+            p.code.push_back(w);
+            p.code.push_back(HALT_WORD);
+            writeReproducer(outDir + path, p, title, diff);
+            return 1;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("%lu words decoded, no mismatches (%.1f M decodes/s)\n", count, count / seconds / 1e6);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    uint64_t seed = chrono::system_clock::now().time_since_epoch().count();
+    uint64_t programs = 100000;
+    unsigned maxLength = 64;
+    uint64_t decodeWords = 0;
+    string outDir = "test";
+    const char *replayFile = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--programs") == 0 && i + 1 < argc) {
+            programs = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--length") == 0 && i + 1 < argc) {
+            maxLength = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--decode") == 0 && i + 1 < argc) {
+            decodeWords = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--out-dir") == 0 && i + 1 < argc) {
+            outDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayFile = argv[++i];
+        }
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    // keep the register table within reach of the prologue's 12-bit immediates
+    if (maxLength < 1 || maxLength > 400) {
+        fprintf(stderr, "--length must be between 1 and 400\n");
+        return -1;
+    }
+
+    Generator gen(seed);
+    Engines engines;
+    uint64_t steps;
+
+    if (replayFile != NULL) {
+        vector<uint8_t> image;
+        if (!loadProgramImage(replayFile, image)) {
+            return -1;
+        }
+        string diff = runLockstep(engines, image, steps);
+        printf("%s\n", diff.empty() ? "engines agree" : diff.c_str());
+        return diff.empty() ? 0 : 1;
+    }
+    if (decodeWords > 0) {
+        return fuzzDecode(gen, decodeWords, outDir, seed);
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    uint64_t totalSteps = 0;
+    for (uint64_t n = 0; n < programs; n++) {
+        Program p = gen.program(1 + gen.below(maxLength));
+        string diff = runLockstep(engines, p.image(), steps);
+        totalSteps += steps;
+        if (diff.empty()) {
+            continue;
+        }
+
+        fprintf(stderr, "program %lu: %s\n", n, diff.c_str());
+        minimize(engines, p);
+        diff = runLockstep(engines, p.image(), steps);
+
+        char title[128], path[64];
+        snprintf(title, sizeof(title), "FUZZ: engines disagree (simfuzz --seed %lu, program %lu)", seed, n);
+        snprintf(path, sizeof(path), "/fuzz_%lu_%lu.s", seed, n);
+        fprintf(stderr, "minimized: %s\n", diff.c_str());
+        if (writeReproducer(outDir + path, p, title, diff)) {
+            fprintf(stderr, "reproducer written to %s%s\n", outDir.c_str(), path);
+        }
+        return 1;
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("%lu programs, %lu instructions per engine, no mismatches (seed %lu)\n", programs, totalSteps, seed);
+    printf("%.2f M instructions/s per engine, %.2f M executions/s over all engines\n",
+           totalSteps / seconds / 1e6, 3 * totalSteps / seconds / 1e6);
+    return 0;
+}
@@ -0,0 +1,146 @@
+// Watches a running simulator through the stats file written by sim --stats,
+// printing a line of progress per interval. Only reads the shared page, so the
+// simulator being watched runs exactly as fast as without a reader.
+
+#include "LiveStats.h"
+#include "Simulator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+static const char *MIX_NAMES[MIX_CLASSES] = { "alu", "mul", "ld", "st", "br", "jmp", "sys" };
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <stats_file>\n", prog);
+    fprintf(stderr, "  --interval <ms>   time between lines (default 1000)\n");
+    fprintf(stderr, "  --once            print one line and exit\n");
+}
+
+static const char *statusName(uint64_t status) {
+    switch (status & ~(uint64_t)LIVE_STATS_FINISHED) {
+        case SIM_RUNNING:    return status & LIVE_STATS_FINISHED ? "stopped" : "running";
+        case SIM_HALTED:     return "halted";
+        case SIM_ILLEGAL:    return "illegal";
+        case SIM_BREAKPOINT: return "breakpoint";
+        case SIM_WATCHPOINT: return "watchpoint";
+    }
+    return "?";
+}
+
+// Maps path read-only and checks that it is a stats page this build understands.
+static const LiveStatsPage *mapStats(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+    void *mapped = mmap(NULL, sizeof(LiveStatsPage), PROT_READ, MAP_SHARED, fd, 0);
+    off_t size = lseek(fd, 0, SEEK_END);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+    const LiveStatsPage *page = static_cast<const LiveStatsPage *>(mapped);
+    if (size < (off_t)sizeof(LiveStatsPage) || memcmp(page->magic, LIVE_STATS_MAGIC, sizeof(page->magic)) != 0) {
+        fprintf(stderr, "%s: not a simulator stats file\n", path);
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (page->version != LIVE_STATS_VERSION || page->size != sizeof(LiveStatsPage)) {
+        fprintf(stderr, "%s: stats version %u, this simtop reads version %u\n", path,
+                page->version, LIVE_STATS_VERSION);
+        return NULL;
+    }
+    return page;
+}
+
+static void printHeader(const LiveStatsPage *page) {
+    printf("# %s, pid %lu\n", page->program, page->pid);
+    printf("%8s %14s %10s %8s %8s ", "time", "instructions", "pc", "MIPS", "avg");
+    for (int c = 0; c < MIX_CLASSES; c++) {
+        printf("%4s ", MIX_NAMES[c]);
+    }
+    printf("%4s %9s %9s  %s\n", "rvc", "image", "written", "status");
+}
+
+static void printLine(const LiveStatsPage *page) {
+    uint64_t status = page->status.load(memory_order_relaxed);
+    uint64_t instructions = page->instructions.load(memory_order_relaxed);
+    uint64_t pc = page->pc.load(memory_order_relaxed);
+    double seconds = page->elapsedNanos.load(memory_order_relaxed) / 1e9;
+    double recent = page->recentIps.load(memory_order_relaxed) / 1e6;
+
+    // percentages of the mix total, which may be a little ahead of instructions
+    uint64_t mix[MIX_CLASSES];
+    uint64_t total = 0;
+    for (int c = 0; c < MIX_CLASSES; c++) {
+        mix[c] = page->mix[c].load(memory_order_relaxed);
+        total += mix[c];
+    }
+    uint64_t compressed = page->compressed.load(memory_order_relaxed);
+    double percent = total > 0 ? 100.0 / total : 0;
+
+    printf("%7.1fs %14lu %#10lx %8.1f %8.1f ", seconds, instructions, pc, recent,
+           seconds > 0 ? instructions / seconds / 1e6 : 0.0);
+    for (int c = 0; c < MIX_CLASSES; c++) {
+        printf("%3.0f%% ", mix[c] * percent);
+    }
+    printf("%3.0f%% %9lu %9lu  %s\n", compressed * percent,
+           page->imageBytes.load(memory_order_relaxed),
+           page->writtenBytes.load(memory_order_relaxed), statusName(status));
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    unsigned interval = 1000;
+    bool once = false;
+    const char *statsFile = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval = strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--once") == 0) {
+            once = true;
+        }
+        else if (argv[i][0] != '-' && statsFile == NULL) {
+            statsFile = argv[i];
+        }
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (statsFile == NULL) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    const LiveStatsPage *page = mapStats(statsFile);
+    if (page == NULL) {
+        return -1;
+    }
+    printHeader(page);
+    for (;;) {
+        printLine(page);
+        if (once || (page->status.load(memory_order_relaxed) & LIVE_STATS_FINISHED) != 0) {
+            return 0;
+        }
+        // a simulator that was killed never marks its run finished
+        if (kill((pid_t)page->pid, 0) != 0 && errno == ESRCH) {
+            printf("# pid %lu is gone\n", page->pid);
+            return 1;
+        }
+        this_thread::sleep_for(chrono::milliseconds(interval));
+    }
+}
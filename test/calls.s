@@ -0,0 +1,43 @@
+# ======================================================
+# CALL / RETURN TEST: recursive fib(10) = 55 in a0
+# calls are jal/jalr writing ra, returns are jalr x0, 0(ra)
+# ======================================================
+
+_start:
+lui   sp, 0x8             # sp = 0x8000, stack grows down
+addi  a0, x0, 10
+jal   ra, fib             # a0 = fib(10)
+addi  s1, a0, 0           # s1 = 55
+
+# ---- indirect call through a register ----
+auipc t0, 0
+addi  t0, t0, 16          # t0 = leaf
+jalr  ra, 0(t0)           # s2 = 7
+jal   x0, done
+
+leaf:
+addi  s2, x0, 7
+jalr  x0, 0(ra)
+
+# fib(a0): a0 < 2 ? a0 : fib(a0 - 1) + fib(a0 - 2)
+fib:
+addi  t1, x0, 2
+blt   a0, t1, fib_base
+addi  sp, sp, -24
+sd    ra, 0(sp)
+sd    a0, 8(sp)
+addi  a0, a0, -1
+jal   ra, fib
+sd    a0, 16(sp)          # fib(n - 1)
+ld    a0, 8(sp)
+addi  a0, a0, -2
+jal   ra, fib
+ld    t2, 16(sp)
+add   a0, a0, t2
+ld    ra, 0(sp)
+addi  sp, sp, 24
+fib_base:
+jalr  x0, 0(ra)
+
+done:
+.word 0xfeedfeed
@@ -0,0 +1,62 @@
+# ======================================================
+# COMPRESSED TEST: RV64C mixed with 32-bit instructions,
+# which then sit at addresses 2 past a word boundary
+# ======================================================
+
+.option rvc
+
+c.li    s0, 5                 # s0 = 5
+c.addi  s0, 3                 # s0 = 8
+c.lui   s1, 1                 # s1 = 0x1000
+c.slli  s1, 4                 # s1 = 0x10000
+c.srli  s1, 8                 # s1 = 0x100
+addi    a0, x0, -100          # 32-bit (no compressed form), at 0xa
+c.srai  a0, 2                 # a0 = -25
+c.andi  a0, 7                 # a0 = 7
+c.mv    a1, s0                # a1 = 8
+c.add   a1, a0                # a1 = 15
+c.sub   a1, a0                # a1 = 8
+c.xor   a1, s0                # a1 = 0
+c.or    a1, s1                # a1 = 0x100
+c.and   a1, s0                # a1 = 0
+c.addiw s0, -9                # s0 = -1
+c.addw  a0, s0                # a0 = 6
+c.subw  a0, s0                # a0 = 7
+
+# ---- stack pointer forms, loads and stores ----
+c.nop
+lui     sp, 0x8               # sp = 0x8000, 32-bit at 2 past a word
+c.addi16sp sp, -64            # sp = 0x7fc0
+c.addi4spn a2, sp, 16         # a2 = 0x7fd0
+c.sdsp  s1, 8(sp)
+c.ldsp  a3, 8(sp)             # a3 = 0x100
+c.swsp  s0, 0(sp)
+c.lwsp  a4, 0(sp)             # a4 = -1
+c.sd    a0, 0(a2)
+c.ld    a5, 0(a2)             # a5 = 7
+c.sw    s0, 8(a2)
+c.lw    a2, 8(a2)             # a2 = -1
+
+# ---- control flow: links are the next parcel ----
+c.li    s1, 0
+c.beqz  s1, beq_taken         # taken
+c.li    s1, 1                 # skipped
+beq_taken:
+c.bnez  s1, done              # not taken
+c.j     over
+c.li    s1, 2                 # skipped
+over:
+auipc   t0, 0                 # 32-bit, at 2 past a word
+c.addi  t0, 14                # t0 = leaf
+c.jalr  t0                    # s4 = ra = this + 2
+c.nop
+c.li    s5, 7                 # s5 = 7
+done:
+c.j     finish
+
+leaf:
+c.mv    s4, ra
+c.jr    ra
+
+finish:
+.word 0xfeedfeed
@@ -0,0 +1,37 @@
+# ======================================================
+# DEVICE TEST (run with --devices)
+# prints "hi\n" on the UART, then waits for the timer to
+# fire three times, 100 instructions apart (without the
+# devices, the wait gives up after 1000 rounds)
+# ======================================================
+
+lui   t0, 0x10000             # t0 = UART base
+addi  t1, x0, 104             # 'h'
+sb    t1, 0(t0)
+addi  t1, x0, 105             # 'i'
+sb    t1, 0(t0)
+addi  t1, x0, 10              # '\n'
+sb    t1, 0(t0)
+lbu   s3, 5(t0)               # s3 = 0x60, line status: transmitter idle
+
+lui   t2, 0x10001             # t2 = timer base
+addi  t1, x0, 100
+sd    t1, 16(t2)              # period = 100
+ld    t3, 0(t2)               # t3 = mtime
+add   t3, t3, t1
+sd    t3, 8(t2)               # mtimecmp = mtime + 100
+
+addi  t4, x0, 3
+addi  t5, x0, 1000
+wait:
+ld    s1, 24(t2)              # s1 = times fired
+addi  t5, t5, -1
+beq   t5, x0, gave_up
+blt   s1, t4, wait
+gave_up:
+
+ld    s2, 0(t2)               # s2 = mtime, just past the third firing
+sd    x0, 24(t2)              # clear the count
+ld    s4, 24(t2)              # s4 = 0
+
+.word 0xfeedfeed
@@ -0,0 +1,29 @@
+# ======================================================
+# RV64M TEST: multiply and divide, including division by
+# zero and the overflowing division, which do not trap
+# ======================================================
+
+addi  t0, x0, -7
+addi  t1, x0, 3
+mul   s1, t0, t1              # s1 = -21
+div   s2, t0, t1              # s2 = -2 (rounds towards zero)
+rem   s3, t0, t1              # s3 = -1 (sign of the dividend)
+divu  s4, t1, t0              # s4 = 0
+remu  s5, t1, t0              # s5 = 3
+
+addi  t2, x0, -1
+mulh  s6, t2, t2              # s6 = 0 (high half of 1)
+mulhu s7, t2, t2              # s7 = -2 (0xfffffffffffffffe)
+mulhsu s8, t2, t2             # s8 = -1
+
+div   s9, t0, x0              # s9 = -1 (x / 0)
+rem   s10, t0, x0             # s10 = -7 (x % 0 = x)
+divu  s11, t0, x0             # s11 = -1
+
+addi  t3, x0, 1
+slli  t3, t3, 63              # t3 = most negative
+div   a0, t3, t2              # a0 = most negative (overflow)
+rem   a1, t3, t2              # a1 = 0
+remu  a2, t3, x0              # a2 = most negative
+
+.word 0xfeedfeed
@@ -0,0 +1,28 @@
+# ======================================================
+# RV64M W TEST: 32-bit multiply and divide, results sign
+# extended from bit 31
+# ======================================================
+
+lui   t0, 0x10                # t0 = 0x10000
+mulw  s1, t0, t0              # s1 = 0 (0x100000000 truncated)
+addi  t1, x0, 0x7ff
+slli  t1, t1, 20              # t1 = 0x7ff00000
+mulw  s2, t1, t0              # s2 = 0 (low 32 bits of 0x7ff000000000)
+addi  t2, x0, 3
+mulw  s3, t1, t2              # s3 = sext(0x7fd00000) = 0x7fd00000
+
+addi  t3, x0, -7
+divw  s4, t3, t2              # s4 = -2
+remw  s5, t3, t2              # s5 = -1
+divuw s6, t3, t2              # s6 = 0x55555553 (0xfffffff9 / 3)
+remuw s7, t3, t2              # s7 = 0
+
+divw  s8, t3, x0              # s8 = -1
+remuw s9, t3, x0              # s9 = -7 (sext of 0xfffffff9)
+
+lui   t4, 0x80000             # t4 = sext(0x80000000), most negative word
+addi  t5, x0, -1
+divw  s10, t4, t5             # s10 = sext(0x80000000) (overflow)
+remw  s11, t4, t5             # s11 = 0
+
+.word 0xfeedfeed
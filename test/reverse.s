@@ -0,0 +1,16 @@
+# ======================================================
+# REVERSE TEST: a loop run under the debugger with
+# test/reverse.dbg and a log too small for the steps taken
+# back, so the debugger re-executes from a checkpoint past
+# the breakpoint set in the loop. The output must match
+# test/reverse.ref (see `make check-debug`).
+# Without the debugger: halts with t0 = t1 = 0x100000.
+# ======================================================
+
+addi  t0, x0, 0
+lui   t1, 0x100               # t1 = 0x100000 passes
+loop:
+addi  t0, t0, 1
+bne   t0, t1, loop            # 0xc, the breakpoint
+
+.word 0xfeedfeed
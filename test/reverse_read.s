@@ -0,0 +1,22 @@
+# ======================================================
+# REVERSE READ TEST: a read into memory, run under the
+# debugger with test/reverse_read.dbg and test/reverse_read.in
+# as input. Reverse-stepping stops right after the ecall,
+# so the buffer keeps "abcd" and stepping forward again does
+# not read a second time. The output must match
+# test/reverse_read.ref (see `make check-debug`).
+# ======================================================
+
+auipc s0, 0
+addi  s0, s0, 44              # s0 = data
+addi  a0, x0, 0               # fd 0
+addi  a1, s0, 0
+addi  a2, x0, 4
+addi  a7, x0, 63              # read
+ecall                         # a0 = 4, data = "abcd"
+lw    t0, 0(s0)
+addi  t1, t0, 1
+lw    t2, 0(s0)               # the same "abcd" after going back
+.word 0xfeedfeed
+data:
+.dword 0
@@ -0,0 +1,25 @@
+# ======================================================
+# SPIN TEST: a long loop that changes a register on every
+# pass keeps running; the loop after it stores the same
+# value over and over, changes nothing else, and is stopped
+# as an endless loop (exit code 126, t0 = 0x180000, s1 = 7)
+# ======================================================
+
+addi  t0, x0, 0
+lui   t1, 0x180               # t1 = 0x180000 passes, over 3M instructions
+count:
+addi  t0, t0, 1
+bne   t0, t1, count
+
+auipc s0, 0
+addi  s0, s0, 32              # s0 = data
+addi  s1, x0, 7
+spin:
+sd    s1, 0(s0)               # the same value every time
+ld    s2, 0(s0)
+addi  s3, s2, 1
+jal   x0, spin
+
+.word 0xfeedfeed              # not reached
+data:
+.dword 0
@@ -0,0 +1,38 @@
+# ======================================================
+# SYSTEM CALL TEST: write, brk and exit via ecall
+# prints "hello\n"; the program exits with status 0 before
+# the halt word
+# ======================================================
+
+auipc a1, 0
+addi  a1, a1, 100         # a1 = message
+addi  a0, x0, 1           # fd 1
+addi  a2, x0, 6
+addi  a7, x0, 64          # write
+ecall
+addi  s1, a0, 0           # s1 = 6 bytes written
+
+addi  a0, x0, 9           # fd 9 is not open
+addi  a7, x0, 64
+ecall
+addi  s2, a0, 0           # s2 = -9 (EBADF)
+
+addi  a0, x0, 0
+addi  a7, x0, 214         # brk(0) reports the break
+ecall
+addi  s3, a0, 0           # s3 = end of the program, rounded to 8
+addi  a0, s3, 256
+ecall                     # brk(break + 256) grows the heap
+sub   s4, a0, s3          # s4 = 256
+
+addi  a7, x0, 1000        # not a system call
+ecall
+addi  s5, a0, 0           # s5 = -38 (ENOSYS)
+
+addi  a0, x0, 0
+addi  a7, x0, 93          # exit(0)
+ecall
+.word 0xfeedfeed          # not reached
+
+message:
+.ascii "hello\n"